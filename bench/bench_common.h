@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BENCH_BENCH_COMMON_H_
+#define BENCH_BENCH_COMMON_H_
+
+#include "world/hashlife_world.h"
+#include "world/init.h"
+#include "graphics/drivers/null_driver.h"
+#include "block/builtin/air.h"
+#include "block/builtin/bedrock.h"
+#include "block/builtin/cobblestone.h"
+#include "block/builtin/glowstone.h"
+#include "block/builtin/stone.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace bench
+{
+inline void initAll()
+{
+    world::initAll(new graphics::drivers::NullDriver());
+}
+
+inline block::BlockStepGlobalState makeGlobalState()
+{
+    return block::BlockStepGlobalState(lighting::Lighting::GlobalProperties(
+        lighting::Lighting::maxLight, world::Dimension::overworld()));
+}
+
+/** @return the time fn takes to run in seconds */
+template <typename Fn>
+double timeIt(Fn &&fn)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+inline block::Block makeAir()
+{
+    return block::Block(block::builtin::Air::get()->blockKind,
+                        lighting::Lighting::makeSkyLighting());
+}
+
+/** @return the block of rolling terrain at position in a world that is size blocks on a side */
+inline block::Block getTerrainBlock(util::Vector3I32 position, std::int32_t size)
+{
+    auto height = static_cast<std::int32_t>(size / 2 + 6 * std::sin(position.x * 0.1)
+                                            + 5 * std::cos(position.z * 0.13)
+                                            + 3 * std::sin((position.x + position.z) * 0.05));
+    if(position.y < 2)
+        return block::Block(block::builtin::Bedrock::get()->blockKind);
+    if(position.y < height - 3)
+        return block::Block(block::builtin::Stone::get()->blockKind);
+    if(position.y < height)
+        return block::Block(block::builtin::Cobblestone::get()->blockKind);
+    if(position.y == height && (position.x * 7 + position.z * 13) % 97 == 0)
+        return block::Block(block::builtin::Glowstone::get()->blockKind);
+    return makeAir();
+}
+
+/** fill the cube from minPosition to minPosition + size with terrain */
+inline void generateTerrain(world::HashlifeWorld &world,
+                            util::Vector3I32 minPosition,
+                            std::int32_t size)
+{
+    std::vector<world::HashlifeWorld::BlockEdit> edits;
+    edits.reserve(static_cast<std::size_t>(size) * size * size);
+    for(std::int32_t x = 0; x < size; x++)
+        for(std::int32_t y = 0; y < size; y++)
+            for(std::int32_t z = 0; z < size; z++)
+                edits.emplace_back(minPosition + util::Vector3I32(x, y, z),
+                                   getTerrainBlock(util::Vector3I32(x, y, z), size));
+    world.applyEdits(edits);
+}
+
+/** fill a world that is tileCount by tileCount tiles of size blocks on a side and one tile high
+ * with terrain that doesn't repeat, centered on the origin */
+inline void generateTiledTerrain(world::HashlifeWorld &world,
+                                 std::int32_t tileCount,
+                                 std::int32_t size)
+{
+    std::vector<world::HashlifeWorld::BlockEdit> edits;
+    for(std::int32_t tileX = 0; tileX < tileCount; tileX++)
+    {
+        for(std::int32_t tileZ = 0; tileZ < tileCount; tileZ++)
+        {
+            edits.clear();
+            util::Vector3I32 tilePosition(tileX * size, 0, tileZ * size);
+            util::Vector3I32 minPosition =
+                tilePosition
+                - util::Vector3I32(tileCount * size / 2, size / 2, tileCount * size / 2);
+            for(util::Vector3I32 position(0); position.x < size; position.x++)
+                for(position.y = 0; position.y < size; position.y++)
+                    for(position.z = 0; position.z < size; position.z++)
+                        edits.emplace_back(minPosition + position,
+                                           getTerrainBlock(tilePosition + position, size));
+            world.applyEdits(edits);
+        }
+    }
+}
+
+/** build the demo scene from main.cpp: a bedrock shell around a room with a stone ball */
+inline std::shared_ptr<world::HashlifeWorld> makeDemoWorld()
+{
+    constexpr std::int32_t ballSize = 10, renderRange = ballSize + 1;
+    auto world = world::HashlifeWorld::make();
+    std::vector<world::HashlifeWorld::BlockEdit> edits;
+    for(util::Vector3I32 position(-renderRange); position.x < renderRange; position.x++)
+    {
+        for(position.y = -renderRange; position.y < renderRange; position.y++)
+        {
+            for(position.z = -renderRange; position.z < renderRange; position.z++)
+            {
+                block::Block block = makeAir();
+                if((position * util::Vector3I32(1, 2, 1)).normSquared() >= ballSize * ballSize
+                   && (position.y < (position.x > 0 ? 0 : ballSize * 3 / 8)
+                       || util::Vector3F(position.x, 0, position.z).normSquared()
+                              >= ballSize * ballSize))
+                    block = block::Block(block::builtin::Bedrock::get()->blockKind);
+                else if((position - util::Vector3I32(ballSize / 2)).normSquared()
+                        < ballSize * ballSize / (4 * 4))
+                    block = block::Block(position.y % 2 == 0 ?
+                                             block::builtin::Cobblestone::get()->blockKind :
+                                             block::builtin::Stone::get()->blockKind);
+                edits.emplace_back(position, block);
+            }
+        }
+    }
+    world->applyEdits(edits);
+    return world;
+}
+}
+}
+}
+
+#endif /* BENCH_BENCH_COMMON_H_ */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures what computing HashlifeNodeBase::contentHash adds to building nodes, and how well
+// combineContentHash mixes its input.
+
+#include "bench_common.h"
+#include <algorithm>
+#include <random>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+void benchmarkConstruction()
+{
+    constexpr std::int32_t size = 128;
+    std::mt19937 randomEngine(1);
+    block::Block stone(block::builtin::Stone::get()->blockKind);
+    block::Block cobblestone(block::builtin::Cobblestone::get()->blockKind);
+    // random blocks so most nodes above the leaves are distinct
+    std::vector<std::vector<std::vector<block::Block>>> blocks(
+        size, std::vector<std::vector<block::Block>>(size, std::vector<block::Block>(size)));
+    for(auto &plane : blocks)
+        for(auto &row : plane)
+            for(auto &block : row)
+                block = randomEngine() % 2 ? stone : cobblestone;
+    double bestTime = 1e9;
+    std::size_t nodeCount = 0;
+    for(int i = 0; i < 7; i++)
+    {
+        auto world = world::HashlifeWorld::make();
+        bestTime = std::min(bestTime,
+                            bench::timeIt([&]()
+                                          {
+                                              world->setBlocks(blocks,
+                                                               util::Vector3I32(-size / 2),
+                                                               util::Vector3I32(0),
+                                                               util::Vector3I32(size));
+                                          }));
+        nodeCount = world->getNodeCount();
+    }
+    std::cout << "setBlocks of a random " << size << "^3 world: " << bestTime * 1e3 << " ms for "
+              << nodeCount << " nodes\n";
+    std::cout << "node sizes: leaf " << sizeof(world::HashlifeLeafNode) << " bytes, nonleaf "
+              << sizeof(world::HashlifeNonleafNode) << " bytes\n";
+}
+
+/** flip each input bit of combineContentHash and count how often each output bit changes */
+void measureAvalanche()
+{
+    constexpr int sampleCount = 100000;
+    std::mt19937_64 randomEngine(2);
+    std::vector<std::uint32_t> changeCounts(128 * 64);
+    std::uint64_t hashInputs[2];
+    for(int sample = 0; sample < sampleCount; sample++)
+    {
+        hashInputs[0] = randomEngine();
+        // child hashes are random, but block values and levels are small
+        hashInputs[1] = sample % 2 ? randomEngine() : randomEngine() % 64;
+        auto hash = world::HashlifeNodeBase::combineContentHash(hashInputs[0], hashInputs[1]);
+        for(int inputBit = 0; inputBit < 128; inputBit++)
+        {
+            std::uint64_t flippedInputs[2] = {hashInputs[0], hashInputs[1]};
+            flippedInputs[inputBit / 64] ^= static_cast<std::uint64_t>(1) << inputBit % 64;
+            auto changedBits = hash
+                               ^ world::HashlifeNodeBase::combineContentHash(flippedInputs[0],
+                                                                             flippedInputs[1]);
+            for(int outputBit = 0; outputBit < 64; outputBit++)
+                if((changedBits >> outputBit) & 1)
+                    changeCounts[inputBit * 64 + outputBit]++;
+        }
+    }
+    double worstBias = 0;
+    double totalChangeRate = 0;
+    for(auto changeCount : changeCounts)
+    {
+        double changeRate = static_cast<double>(changeCount) / sampleCount;
+        worstBias = std::max(worstBias, std::fabs(changeRate - 0.5));
+        totalChangeRate += changeRate;
+    }
+    std::cout << "combineContentHash avalanche: flipping an input bit changes "
+              << totalChangeRate / 128 << " of 64 output bits on average; the worst input and "
+              << "output bit pair changes with probability 0.5 +- " << worstBias << "\n";
+}
+}
+
+int main()
+{
+    bench::initAll();
+    benchmarkConstruction();
+    measureAvalanche();
+}
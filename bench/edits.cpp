@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Compares applyEdits against calling setBlock once per edit, for random edits to a terrain
+// world. Both worlds must end up with the same root node.
+
+#include "bench_common.h"
+#include <random>
+
+using namespace programmerjake::voxels;
+
+int main()
+{
+    bench::initAll();
+    constexpr std::int32_t size = 128;
+    std::mt19937 randomEngine(1);
+    std::uniform_int_distribution<std::int32_t> positionDistribution(-size / 2, size / 2 - 1);
+    const block::Block editBlocks[] = {
+        block::Block(block::builtin::Stone::get()->blockKind),
+        block::Block(block::builtin::Glowstone::get()->blockKind),
+    };
+    auto world = world::HashlifeWorld::make();
+    bench::generateTerrain(*world, util::Vector3I32(-size / 2), size);
+    auto terrainSnapshot = world->makeSnapshot();
+    for(std::size_t editCount : {1000, 10000, 100000})
+    {
+        std::vector<world::HashlifeWorld::BlockEdit> edits;
+        for(std::size_t i = 0; i < editCount; i++)
+        {
+            util::Vector3I32 position(positionDistribution(randomEngine),
+                                      positionDistribution(randomEngine),
+                                      positionDistribution(randomEngine));
+            edits.emplace_back(position, editBlocks[randomEngine() % 2]);
+        }
+        world->restoreSnapshot(*terrainSnapshot);
+        double setBlockTime = bench::timeIt([&]()
+                                            {
+                                                for(auto &edit : edits)
+                                                    world->setBlock(std::get<1>(edit),
+                                                                    std::get<0>(edit));
+                                            });
+        auto setBlockSnapshot = world->makeSnapshot();
+        world->restoreSnapshot(*terrainSnapshot);
+        double applyEditsTime = bench::timeIt([&]()
+                                              {
+                                                  world->applyEdits(edits);
+                                              });
+        std::cout << editCount << " edits: setBlock " << setBlockTime * 1e3 << " ms, applyEdits "
+                  << applyEditsTime * 1e3 << " ms (" << setBlockTime / applyEditsTime
+                  << "x)" << std::endl;
+        if(!world->isSame(setBlockSnapshot))
+        {
+            std::cout << "applyEdits made a different world than setBlock" << std::endl;
+            return 1;
+        }
+    }
+}
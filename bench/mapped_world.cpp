@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures the time to the first frame after opening a saved world of increasing size: reading
+// the whole world with readSnapshot, against opening it as a MappedWorldFile, materializing only
+// the region around the camera, and letting rendering fault in whatever else it touches.
+// usage: mapped_world [view distance]; 48 by default.
+
+#include "bench_common.h"
+#include "io/file_stream.h"
+#include "io/mapped_file.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+constexpr std::int32_t tileSize = 64;
+const char *const streamFileName = "mapped_world_bench.tmp";
+const char *const mappedFileName = "mapped_world_bench_mapped.tmp";
+
+/** mesh every chunk in view, like the first frame of main.cpp's game loop */
+void renderFirstFrame(world::HashlifeWorld &world,
+                      util::Vector3F viewLocation,
+                      float viewDistance,
+                      const block::BlockStepGlobalState &globalState)
+{
+    world::HashlifeWorld::GPURenderBufferCache gpuRenderBufferCache;
+    world.updateView(
+        util::FunctionReference<std::shared_ptr<graphics::ReadableRenderBuffer>(
+            std::shared_ptr<world::HashlifeWorld::RenderCacheEntryReference>)>(
+            [](const std::shared_ptr<world::HashlifeWorld::RenderCacheEntryReference> &key)
+            {
+                return world::HashlifeWorld::renderRenderCacheEntry(key);
+            }),
+        util::FunctionReference<void(
+            std::shared_ptr<world::HashlifeWorld::GPURenderBufferCache::Entry>)>(
+            [](const std::shared_ptr<world::HashlifeWorld::GPURenderBufferCache::Entry> &)
+            {
+            }),
+        viewLocation,
+        viewDistance,
+        globalState,
+        gpuRenderBufferCache);
+}
+}
+
+int main(int argc, char **argv)
+{
+    float viewDistance = argc > 1 ? std::atof(argv[1]) : 48;
+    bench::initAll();
+    auto globalState = bench::makeGlobalState();
+    util::Vector3F viewLocation(0.5f, 8.5f, 0.5f);
+    util::Vector3I32 viewMinPosition(viewLocation - util::Vector3F(viewDistance));
+    util::Vector3I32 viewMaxPosition(viewLocation + util::Vector3F(viewDistance));
+    for(std::int32_t tileCount : {1, 2, 4, 8, 16})
+    {
+        auto world = world::HashlifeWorld::make();
+        bench::generateTiledTerrain(*world, tileCount, tileSize);
+        auto snapshot = world->makeSnapshot();
+        {
+            io::FileOutputStream os(streamFileName);
+            world::HashlifeWorld::writeSnapshot(*snapshot, os);
+        }
+        {
+            io::FileOutputStream os(mappedFileName);
+            world::HashlifeWorld::writeMappedSnapshot(*snapshot, os);
+        }
+        auto fullWorld = world::HashlifeWorld::make();
+        double fullLoadTime = bench::timeIt([&]()
+                                            {
+                                                io::FileInputStream is(streamFileName);
+                                                fullWorld->load(is);
+                                            });
+        double fullFrameTime = bench::timeIt([&]()
+                                             {
+                                                 renderFirstFrame(*fullWorld,
+                                                                  viewLocation,
+                                                                  viewDistance,
+                                                                  globalState);
+                                             });
+        auto lazyWorld = world::HashlifeWorld::make();
+        std::shared_ptr<world::HashlifeWorld::MappedWorldFile> mappedWorldFile;
+        double lazyLoadTime = bench::timeIt(
+            [&]()
+            {
+                mappedWorldFile = std::make_shared<world::HashlifeWorld::MappedWorldFile>(
+                    std::make_shared<io::MappedFile>(mappedFileName));
+                lazyWorld->restoreSnapshot(*lazyWorld->materializeRegion(
+                    mappedWorldFile, viewMinPosition, viewMaxPosition));
+            });
+        double lazyFrameTime = bench::timeIt([&]()
+                                             {
+                                                 renderFirstFrame(*lazyWorld,
+                                                                  viewLocation,
+                                                                  viewDistance,
+                                                                  globalState);
+                                             });
+        std::size_t materializedNodeCount = mappedWorldFile->getMaterializedNodeCount();
+        std::size_t stubCount = lazyWorld->getEvictedSubtreeCount();
+        lazyWorld->faultInSubtrees(lazyWorld->minPosition(), lazyWorld->maxPosition());
+        std::size_t mismatchCount = 0;
+        auto worldSize = tileCount * tileSize;
+        for(util::Vector3I32 position(-worldSize / 2); position.x < worldSize / 2; position.x += 3)
+            for(position.y = -tileSize / 2; position.y < tileSize / 2; position.y += 3)
+                for(position.z = -worldSize / 2; position.z < worldSize / 2; position.z += 3)
+                    if(lazyWorld->get(position) != fullWorld->get(position))
+                        mismatchCount++;
+        std::cout << worldSize << "x" << tileSize << "x" << worldSize << " blocks, "
+                  << mappedWorldFile->getNodeCount() << " nodes: readSnapshot "
+                  << fullLoadTime * 1e3 << " ms + frame " << fullFrameTime * 1e3 << " ms = "
+                  << (fullLoadTime + fullFrameTime) * 1e3 << " ms; mapped "
+                  << lazyLoadTime * 1e3 << " ms + frame " << lazyFrameTime * 1e3 << " ms = "
+                  << (lazyLoadTime + lazyFrameTime) * 1e3 << " ms ("
+                  << materializedNodeCount << " nodes read, " << stubCount << " stubs left)"
+                  << std::endl;
+        if(mismatchCount != 0)
+        {
+            std::cout << mismatchCount << " blocks differ after faulting in the whole world"
+                      << std::endl;
+            return 1;
+        }
+    }
+    std::remove(streamFileName);
+    std::remove(mappedFileName);
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures how much a memo section in a world file speeds up stepping right after loading.
+// usage: memo [seconds]; each phase steps for that many seconds, 60 by default.
+
+#include "bench_common.h"
+#include "io/memory_stream.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+struct StepResult final
+{
+    std::size_t stepCount = 0;
+    double firstStepTime = 0;
+    double totalTime = 0;
+};
+
+StepResult stepFor(world::HashlifeWorld &world,
+                   const block::BlockStepGlobalState &globalState,
+                   double seconds)
+{
+    StepResult retval;
+    while(retval.totalTime < seconds)
+    {
+        double stepTime = bench::timeIt([&]()
+                                        {
+                                            world.step(globalState);
+                                        });
+        if(retval.stepCount == 0)
+            retval.firstStepTime = stepTime;
+        retval.totalTime += stepTime;
+        retval.stepCount++;
+    }
+    return retval;
+}
+
+void printStepResult(const char *name, const StepResult &result)
+{
+    std::cout << name << ": first step " << result.firstStepTime * 1e3 << " ms, "
+              << result.stepCount << " steps in " << result.totalTime << " s = "
+              << result.stepCount / result.totalTime << " TPS\n";
+}
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 60;
+    bench::initAll();
+    auto globalState = bench::makeGlobalState();
+    constexpr std::int32_t size = 64;
+    auto world = world::HashlifeWorld::make();
+    bench::generateTerrain(*world, util::Vector3I32(-size / 2), size);
+    printStepResult("before saving", stepFor(*world, globalState, seconds));
+    auto snapshot = world->makeSnapshot();
+    io::MemoryOutputStream plainStream, memoStream;
+    world::HashlifeWorld::writeSnapshot(*snapshot, plainStream);
+    double saveTime = bench::timeIt([&]()
+                                    {
+                                        world->writeSnapshotAndMemo(*snapshot, memoStream);
+                                    });
+    auto plainFile = plainStream.releaseBuffer();
+    auto memoFile = memoStream.releaseBuffer();
+    std::cout << "file without memo " << plainFile.size() << " bytes, with memo "
+              << memoFile.size() << " bytes, saved in " << saveTime * 1e3 << " ms\n";
+    // changing the step fingerprint at the start of the memo section must make the memo be
+    // ignored
+    auto otherRulesMemoFile = memoFile;
+    unsigned char fingerprintBytes[8];
+    for(std::size_t i = 0; i < 8; i++)
+        fingerprintBytes[i] = block::BlockDescriptor::getStepFingerprint() >> 8 * i;
+    auto fingerprintIterator = std::search(otherRulesMemoFile.begin(),
+                                           otherRulesMemoFile.end(),
+                                           std::begin(fingerprintBytes),
+                                           std::end(fingerprintBytes));
+    if(fingerprintIterator == otherRulesMemoFile.end())
+    {
+        std::cout << "step fingerprint not found in the memo section" << std::endl;
+        return 1;
+    }
+    *fingerprintIterator ^= 1;
+    struct LoadCase final
+    {
+        const char *name;
+        const std::vector<unsigned char> *file;
+    };
+    for(auto &loadCase : {LoadCase{"without memo", &plainFile},
+                          LoadCase{"with memo", &memoFile},
+                          LoadCase{"with memo from other block rules", &otherRulesMemoFile}})
+    {
+        auto loadedWorld = world::HashlifeWorld::make();
+        io::MemoryInputStream is(*loadCase.file);
+        double loadTime = bench::timeIt([&]()
+                                        {
+                                            loadedWorld->load(is);
+                                        });
+        std::cout << loadCase.name << ": load " << loadTime * 1e3 << " ms\n";
+        printStepResult(loadCase.name, stepFor(*loadedWorld, globalState, seconds));
+    }
+    // a file cut off in the middle of the memo section must not leave any futures applied, so
+    // loading the same nodes without a memo afterwards must step as slowly as without a memo
+    std::vector<unsigned char> truncatedFile(memoFile.begin(), memoFile.end() - 1);
+    auto loadedWorld = world::HashlifeWorld::make();
+    try
+    {
+        io::MemoryInputStream is(truncatedFile);
+        loadedWorld->load(is);
+        std::cout << "truncated memo loaded without an error" << std::endl;
+        return 1;
+    }
+    catch(io::IOError &)
+    {
+    }
+    io::MemoryInputStream is(plainFile);
+    loadedWorld->load(is);
+    printStepResult("after a truncated memo", stepFor(*loadedWorld, globalState, seconds));
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures predictRegion against stepping the whole world: for a small box in a wide terrain
+// world, the time to predict the box cold and again with the memoized futures, and the time to
+// step the whole world the same number of times. The predicting and stepping worlds are loaded
+// separately so no futures are shared. The prediction must match the stepped world.
+
+#include "bench_common.h"
+#include "io/memory_stream.h"
+#include <algorithm>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+constexpr std::int32_t tileCount = 8;
+constexpr std::int32_t tileSize = 64;
+constexpr std::int32_t boxSize = 16;
+
+std::shared_ptr<world::HashlifeWorld> loadWorld(const std::vector<unsigned char> &file)
+{
+    auto world = world::HashlifeWorld::make();
+    io::MemoryInputStream is(file);
+    world->load(is);
+    return world;
+}
+}
+
+int main()
+{
+    bench::initAll();
+    std::vector<unsigned char> file;
+    {
+        auto world = world::HashlifeWorld::make();
+        bench::generateTiledTerrain(*world, tileCount, tileSize);
+        io::MemoryOutputStream os;
+        world->save(os);
+        file = os.releaseBuffer();
+    }
+    const util::Vector3I32 boxMin(-boxSize / 2), boxMax(boxSize / 2 - 1);
+    const double worldVolume =
+        static_cast<double>(tileCount * tileSize) * (tileCount * tileSize) * tileSize;
+    const auto stepSize =
+        static_cast<std::int32_t>(block::BlockStepGlobalState::stepSizeInGenerations);
+    auto stepWorld = loadWorld(file);
+    double stepTime = 0;
+    for(std::size_t stepCount : {1, 2})
+    {
+        std::vector<block::BlockStepGlobalState> globalStates(stepCount,
+                                                              bench::makeGlobalState());
+        // every generation can reach one block further in each direction
+        auto lightConeRadius = static_cast<std::int32_t>(stepCount) * stepSize;
+        auto lightConeSize = boxSize + 2 * lightConeRadius;
+        double lightConeFraction = static_cast<double>(lightConeSize) * lightConeSize
+                                   * std::min(lightConeSize, tileSize) / worldVolume;
+        auto predictWorld = loadWorld(file);
+        auto startSnapshot = predictWorld->makeSnapshot();
+        std::shared_ptr<const world::HashlifeWorld::Snapshot> prediction;
+        double coldTime = bench::timeIt(
+            [&]()
+            {
+                prediction = predictWorld->predictRegion(
+                    *startSnapshot, boxMin, boxMax, globalStates);
+            });
+        double warmTime = bench::timeIt(
+            [&]()
+            {
+                prediction = predictWorld->predictRegion(
+                    *startSnapshot, boxMin, boxMax, globalStates);
+            });
+        stepTime += bench::timeIt(
+            [&]()
+            {
+                stepWorld->step(globalStates.back());
+            });
+        auto stepped = stepWorld->makeSnapshot();
+        std::size_t mismatchCount = 0, changedCount = 0;
+        for(util::Vector3I32 position = boxMin; position.x <= boxMax.x; position.x++)
+        {
+            for(position.y = boxMin.y; position.y <= boxMax.y; position.y++)
+            {
+                for(position.z = boxMin.z; position.z <= boxMax.z; position.z++)
+                {
+                    if(prediction->get(position) != stepped->get(position))
+                        mismatchCount++;
+                    if(startSnapshot->get(position) != stepped->get(position))
+                        changedCount++;
+                }
+            }
+        }
+        std::cout << stepCount << " step(s) of " << stepSize << " generations, " << boxSize
+                  << "^3 box, light cone " << lightConeFraction * 100
+                  << "% of the world: predict cold " << coldTime * 1e3 << " ms, warm "
+                  << warmTime * 1e3 << " ms; stepping the world " << stepTime * 1e3 << " ms ("
+                  << stepTime / coldTime << "x cold predict); " << changedCount
+                  << " blocks changed in the box, " << mismatchCount << " mismatches"
+                  << std::endl;
+        if(mismatchCount != 0)
+            return 1;
+    }
+}
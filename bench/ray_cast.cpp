@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Compares HashlifeWorld::Snapshot::castRay and castRays against walking each ray with
+// util::ray_casting::RayBlockIterator and looking up every block.
+
+#include "bench_common.h"
+#include "util/ray_casting.h"
+#include <random>
+#include <string>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+typedef util::Optional<world::HashlifeWorld::RayCastHit> Hit;
+
+Hit castRayWithIterator(const world::HashlifeWorld::Snapshot &snapshot,
+                        const util::ray_casting::Ray &ray,
+                        float maxT)
+{
+    for(auto iter = util::ray_casting::makeRayBlockIterator(ray); std::get<0>(*iter) <= maxT;
+        ++iter)
+    {
+        util::Vector3I32 position = std::get<1>(*iter);
+        auto block = snapshot.get(position);
+        if(block::BlockDescriptor::getBlockSummary(block.getBlockKind())
+               .areAllBlocksRenderedLikeAir)
+            continue;
+        world::HashlifeWorld::RayCastHit hit;
+        hit.t = std::get<0>(*iter);
+        hit.blockPosition = position;
+        hit.block = block;
+        return hit;
+    }
+    return util::nullOpt;
+}
+
+std::size_t countMismatches(const std::vector<Hit> &expected, const std::vector<Hit> &actual)
+{
+    std::size_t retval = 0;
+    for(std::size_t i = 0; i < expected.size(); i++)
+    {
+        if(static_cast<bool>(expected[i]) != static_cast<bool>(actual[i]))
+            retval++;
+        else if(expected[i]
+                && (expected[i]->blockPosition != actual[i]->blockPosition
+                    || std::fabs(expected[i]->t - actual[i]->t) > 1e-3f))
+            retval++;
+    }
+    return retval;
+}
+
+/** @return the number of rays where castRay or castRays doesn't match RayBlockIterator */
+std::size_t runBenchmark(const world::HashlifeWorld::Snapshot &snapshot,
+                         const std::string &name,
+                         const std::vector<util::ray_casting::Ray> &rays,
+                         float maxT)
+{
+    std::vector<Hit> iteratorHits, singleHits, packetHits;
+    iteratorHits.reserve(rays.size());
+    singleHits.reserve(rays.size());
+    double iteratorTime = bench::timeIt([&]()
+                                        {
+                                            for(auto &ray : rays)
+                                                iteratorHits.push_back(
+                                                    castRayWithIterator(snapshot, ray, maxT));
+                                        });
+    double singleTime = bench::timeIt([&]()
+                                      {
+                                          for(auto &ray : rays)
+                                              singleHits.push_back(snapshot.castRay(ray, maxT));
+                                      });
+    double packetTime = bench::timeIt([&]()
+                                      {
+                                          packetHits = snapshot.castRays(rays, maxT);
+                                      });
+    std::size_t hitCount = 0;
+    for(auto &hit : iteratorHits)
+        if(hit)
+            hitCount++;
+    std::size_t mismatchCount = 0;
+    auto report = [&](const char *method, double time, const std::vector<Hit> &hits)
+    {
+        auto methodMismatchCount = countMismatches(iteratorHits, hits);
+        mismatchCount += methodMismatchCount;
+        std::cout << "  " << method << ": " << time * 1e3 << " ms, "
+                  << rays.size() / time / 1e6 << " Mrays/s, " << methodMismatchCount
+                  << " mismatches\n";
+    };
+    std::cout << name << ": " << rays.size() << " rays, " << hitCount << " hits\n";
+    report("RayBlockIterator", iteratorTime, iteratorHits);
+    report("castRay", singleTime, singleHits);
+    report("castRays", packetTime, packetHits);
+    return mismatchCount;
+}
+}
+
+int main()
+{
+    bench::initAll();
+    auto world = bench::makeDemoWorld();
+    // grow the world so the rays start deep in the tree like they do after the world expands
+    world->setBlock(block::Block(), util::Vector3I32(1 << 12));
+    auto snapshot = world->makeSnapshot();
+    constexpr float maxT = 200;
+    std::mt19937 randomEngine(4);
+    std::uniform_real_distribution<float> positionDistribution(-60, 60);
+    std::uniform_real_distribution<float> directionDistribution(-1, 1);
+    auto randomVector = [&](std::uniform_real_distribution<float> &distribution)
+    {
+        return util::Vector3F(
+            distribution(randomEngine), distribution(randomEngine), distribution(randomEngine));
+    };
+    std::vector<util::ray_casting::Ray> randomRays;
+    for(int i = 0; i < 10000; i++)
+    {
+        util::Vector3F startPosition = randomVector(positionDistribution);
+        util::Vector3F direction;
+        if(i % 2)
+        {
+            // aim half the rays near the middle of the scene so they hit something
+            direction = randomVector(directionDistribution) * util::Vector3F(8) - startPosition;
+        }
+        else
+        {
+            do
+            {
+                direction = randomVector(directionDistribution);
+            } while(direction.normSquared() < 0.01f);
+        }
+        randomRays.emplace_back(world::Position3F(startPosition, world::Dimension::overworld()),
+                                direction.normalizeNonzero());
+    }
+    // RayBlockIterator accumulates t in float, so where a ray crosses two block boundaries at
+    // nearly the same t it can step across them in the other order; those differences are only
+    // reported
+    runBenchmark(*snapshot, "random rays", randomRays, maxT);
+    std::vector<util::ray_casting::Ray> cameraRays;
+    util::Vector3F eyePosition(30, 12, 25);
+    util::Vector3F forward = (util::Vector3F(0) - eyePosition).normalizeNonzero();
+    for(int y = 0; y < 512; y++)
+    {
+        for(int x = 0; x < 512; x++)
+        {
+            util::Vector3F direction = forward
+                                       + util::Vector3F((x - 256) / 400.0f,
+                                                        (y - 256) / 400.0f,
+                                                        (x - y) / 800.0f);
+            cameraRays.emplace_back(world::Position3F(eyePosition, world::Dimension::overworld()),
+                                    direction.normalizeNonzero());
+        }
+    }
+    runBenchmark(*snapshot, "512x512 camera rays", cameraRays, maxT);
+    // rays that start on a block corner or center and move diagonally reach several block
+    // boundaries at exactly the same t, so these check that ties are broken like
+    // RayBlockIterator does
+    std::vector<util::ray_casting::Ray> edgeAlignedRays;
+    std::uniform_int_distribution<std::int32_t> gridDistribution(-40, 40);
+    for(int i = 0; i < 10000; i++)
+    {
+        util::Vector3F direction;
+        do
+        {
+            std::uniform_int_distribution<int> componentDistribution(-1, 1);
+            direction = util::Vector3F(componentDistribution(randomEngine),
+                                       componentDistribution(randomEngine),
+                                       componentDistribution(randomEngine));
+        } while(direction == util::Vector3F(0));
+        util::Vector3F startPosition(gridDistribution(randomEngine),
+                                     gridDistribution(randomEngine),
+                                     gridDistribution(randomEngine));
+        if(i % 2)
+            startPosition = startPosition + util::Vector3F(0.5f);
+        edgeAlignedRays.emplace_back(
+            world::Position3F(startPosition, world::Dimension::overworld()),
+            direction.normalizeNonzero());
+    }
+    std::size_t edgeAlignedMismatchCount =
+        runBenchmark(*snapshot, "edge aligned rays", edgeAlignedRays, maxT);
+    if(edgeAlignedMismatchCount != 0)
+    {
+        std::cout << "castRay doesn't match RayBlockIterator" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Compares SnapshotCursor::get against Snapshot::get for a sequential scan, a random walk to
+// neighboring blocks, and random positions, in a terrain world with a deep tree.
+
+#include "bench_common.h"
+#include <random>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+template <typename Get>
+double timeReads(const std::vector<util::Vector3I32> &positions,
+                 Get &&get,
+                 block::Block::ValueType &checksum)
+{
+    checksum = 0;
+    return bench::timeIt([&]()
+                         {
+                             for(auto &position : positions)
+                                 checksum += get(position).value;
+                         });
+}
+}
+
+int main()
+{
+    bench::initAll();
+    constexpr std::int32_t size = 256;
+    auto world = world::HashlifeWorld::make();
+    bench::generateTerrain(*world, util::Vector3I32(-size / 2), size);
+    // a far away block makes the tree as deep as a big world's
+    world->setBlock(bench::makeAir(), util::Vector3I32(1 << 20));
+    auto snapshot = world->makeSnapshot();
+    std::mt19937 randomEngine(1);
+    std::vector<util::Vector3I32> scanPositions, walkPositions, randomPositions;
+    for(util::Vector3I32 position(-size / 2); position.x < size / 2; position.x++)
+        for(position.y = -size / 2; position.y < size / 2; position.y++)
+            for(position.z = -size / 2; position.z < size / 2; position.z++)
+                scanPositions.push_back(position);
+    util::Vector3I32 walkPosition(0);
+    for(std::size_t i = 0; i < 10000000; i++)
+    {
+        std::int32_t step = randomEngine() % 2 ? 1 : -1;
+        switch(randomEngine() % 3)
+        {
+        case 0:
+            walkPosition.x += step;
+            break;
+        case 1:
+            walkPosition.y += step;
+            break;
+        default:
+            walkPosition.z += step;
+            break;
+        }
+        walkPositions.push_back(walkPosition);
+    }
+    std::uniform_int_distribution<std::int32_t> positionDistribution(-(1 << 21), 1 << 21);
+    for(std::size_t i = 0; i < 1000000; i++)
+        randomPositions.emplace_back(positionDistribution(randomEngine),
+                                     positionDistribution(randomEngine),
+                                     positionDistribution(randomEngine));
+    struct Case final
+    {
+        const char *name;
+        const std::vector<util::Vector3I32> *positions;
+    };
+    for(auto &readCase : {Case{"sequential scan", &scanPositions},
+                          Case{"neighbor walk", &walkPositions},
+                          Case{"random", &randomPositions}})
+    {
+        block::Block::ValueType snapshotChecksum, cursorChecksum;
+        double snapshotTime = timeReads(*readCase.positions,
+                                        [&](util::Vector3I32 position)
+                                        {
+                                            return snapshot->get(position);
+                                        },
+                                        snapshotChecksum);
+        world::HashlifeWorld::SnapshotCursor cursor(snapshot);
+        double cursorTime = timeReads(*readCase.positions,
+                                      [&](util::Vector3I32 position)
+                                      {
+                                          return cursor.get(position);
+                                      },
+                                      cursorChecksum);
+        std::cout << readCase.name << ", " << readCase.positions->size()
+                  << " reads: Snapshot::get " << snapshotTime * 1e3 << " ms, cursor "
+                  << cursorTime * 1e3 << " ms (" << snapshotTime / cursorTime << "x)"
+                  << std::endl;
+        if(snapshotChecksum != cursorChecksum)
+        {
+            std::cout << "the cursor read different blocks" << std::endl;
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures reading and writing 100M little endian 32-bit integers one at a time through the
+// memory and file streams, with and without io::BufferedInputStream and
+// io::BufferedOutputStream, and checks a round trip of mixed reads and writes through small
+// buffers.
+
+#include "io/buffered_stream.h"
+#include "io/file_stream.h"
+#include "io/memory_stream.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+constexpr std::size_t valueCount = 100000000;
+const char *const fileName = "streams_bench.tmp";
+
+template <typename Fn>
+double timeIt(Fn &&fn)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+std::uint32_t getValue(std::size_t index) noexcept
+{
+    return static_cast<std::uint32_t>(index * 2654435761UL);
+}
+
+void printTime(const char *name, double time)
+{
+    std::cout << name << ": " << time * 1e3 << " ms = " << valueCount / time / 1e6
+              << "M values/s" << std::endl;
+}
+
+template <typename InputStream>
+bool timeReads(const char *name, InputStream &is)
+{
+    std::size_t mismatchCount = 0;
+    printTime(name,
+              timeIt([&]()
+                     {
+                         for(std::size_t i = 0; i < valueCount; i++)
+                             if(is.readU32() != getValue(i))
+                                 mismatchCount++;
+                     }));
+    if(mismatchCount != 0)
+    {
+        std::cout << mismatchCount << " values read wrong" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/** @return the number of values read back wrong */
+std::size_t checkMixedRoundTrip()
+{
+    constexpr std::uint64_t recordCount = 100000;
+    io::MemoryOutputStream memoryOutputStream;
+    {
+        io::BufferedOutputStream os(memoryOutputStream, 13);
+        for(std::uint64_t i = 0; i < recordCount; i++)
+        {
+            os.writeVarU64(i * i * i);
+            os.writeU16(i);
+            os.writeU8(i);
+            os.writeU64(~i);
+            unsigned char bytes[40] = {static_cast<unsigned char>(i)};
+            os.writeBytes(bytes, i % 40);
+        }
+        os.flush();
+    }
+    io::MemoryInputStream memoryInputStream(memoryOutputStream.releaseBuffer());
+    io::BufferedInputStream is(memoryInputStream, 7);
+    std::size_t mismatchCount = 0;
+    for(std::uint64_t i = 0; i < recordCount; i++)
+    {
+        if(is.readVarU64() != i * i * i)
+            mismatchCount++;
+        if(is.readU16() != static_cast<std::uint16_t>(i))
+            mismatchCount++;
+        if(is.readU8() != static_cast<std::uint8_t>(i))
+            mismatchCount++;
+        if(is.readU64() != ~i)
+            mismatchCount++;
+        unsigned char bytes[40];
+        is.readAllBytes(bytes, i % 40);
+        if(i % 40 != 0 && bytes[0] != static_cast<std::uint8_t>(i))
+            mismatchCount++;
+    }
+    unsigned char byte;
+    if(!is.readBytes(&byte, 1).hitEOF)
+        mismatchCount++;
+    return mismatchCount;
+}
+}
+
+int main()
+{
+    std::vector<unsigned char> data;
+    {
+        io::MemoryOutputStream os(valueCount * sizeof(std::uint32_t));
+        printTime("MemoryOutputStream::writeU32",
+                  timeIt([&]()
+                         {
+                             for(std::size_t i = 0; i < valueCount; i++)
+                                 os.writeU32(getValue(i));
+                         }));
+    }
+    {
+        io::MemoryOutputStream memoryOutputStream(valueCount * sizeof(std::uint32_t));
+        io::BufferedOutputStream os(memoryOutputStream);
+        printTime("BufferedOutputStream(memory)::writeU32",
+                  timeIt([&]()
+                         {
+                             for(std::size_t i = 0; i < valueCount; i++)
+                                 os.writeU32(getValue(i));
+                             os.flush();
+                         }));
+        data = memoryOutputStream.releaseBuffer();
+    }
+    auto sharedData = std::make_shared<const std::vector<unsigned char>>(std::move(data));
+    {
+        io::MemoryInputStream is(sharedData);
+        if(!timeReads("MemoryInputStream::readU32", is))
+            return 1;
+    }
+    {
+        io::MemoryInputStream memoryInputStream(sharedData);
+        io::BufferedInputStream is(memoryInputStream);
+        if(!timeReads("BufferedInputStream(memory)::readU32", is))
+            return 1;
+    }
+    {
+        io::FileOutputStream os(fileName);
+        os.writeBytes(sharedData->data(), sharedData->size());
+        os.close();
+    }
+    sharedData.reset();
+    {
+        io::FileInputStream is(fileName);
+        if(!timeReads("FileInputStream::readU32", is))
+            return 1;
+    }
+    {
+        io::FileInputStream fileInputStream(fileName);
+        io::BufferedInputStream is(fileInputStream);
+        if(!timeReads("BufferedInputStream(file)::readU32", is))
+            return 1;
+    }
+    std::remove(fileName);
+    std::size_t mismatchCount = checkMixedRoundTrip();
+    std::cout << "mixed round trip through small buffers: " << mismatchCount << " mismatches"
+              << std::endl;
+    if(mismatchCount != 0)
+        return 1;
+}
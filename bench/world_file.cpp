@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Measures saving and loading world files: the size, and the time and throughput of
+// writeSnapshot and readSnapshot with and without compression, for a terrain world and for a
+// world made of copies of it. Reloading and saving again must give the same bytes.
+
+#include "bench_common.h"
+#include "io/memory_stream.h"
+#include <algorithm>
+
+using namespace programmerjake::voxels;
+
+namespace
+{
+constexpr int repeatCount = 5;
+
+/** @return the shortest time fn takes out of repeatCount runs */
+template <typename Fn>
+double minimumTime(Fn &&fn)
+{
+    double retval = 0;
+    for(int i = 0; i < repeatCount; i++)
+    {
+        double time = bench::timeIt(fn);
+        if(i == 0 || time < retval)
+            retval = time;
+    }
+    return retval;
+}
+
+bool measure(const char *name, const world::HashlifeWorld::Snapshot &snapshot, double blockCount)
+{
+    io::MemoryOutputStream mappedStream;
+    world::HashlifeWorld::writeMappedSnapshot(snapshot, mappedStream);
+    std::size_t mappedSize = mappedStream.releaseBuffer().size();
+    std::cout << name << ": " << blockCount << " blocks, mapped format " << mappedSize
+              << " bytes\n";
+    for(bool useCompression : {false, true})
+    {
+        std::vector<unsigned char> file;
+        double saveTime = minimumTime([&]()
+                                      {
+                                          io::MemoryOutputStream os;
+                                          world::HashlifeWorld::writeSnapshot(
+                                              snapshot, os, useCompression);
+                                          file = os.releaseBuffer();
+                                      });
+        double loadTime = minimumTime([&]()
+                                      {
+                                          auto world = world::HashlifeWorld::make();
+                                          io::MemoryInputStream is(file);
+                                          world->load(is);
+                                      });
+        auto world = world::HashlifeWorld::make();
+        io::MemoryInputStream is(file);
+        world->load(is);
+        // save writes without compression, so compare with an uncompressed file
+        io::MemoryOutputStream expectedStream, reloadedStream;
+        world::HashlifeWorld::writeSnapshot(snapshot, expectedStream);
+        world->save(reloadedStream);
+        bool isSame = reloadedStream.releaseBuffer() == expectedStream.releaseBuffer();
+        std::cout << "  " << (useCompression ? "compressed" : "uncompressed") << ": "
+                  << file.size() << " bytes (" << file.size() * 8.0 / blockCount
+                  << " bits per block), save " << saveTime * 1e3 << " ms = "
+                  << file.size() / saveTime / 1e6 << " MB/s, load " << loadTime * 1e3
+                  << " ms = " << file.size() / loadTime / 1e6 << " MB/s" << std::endl;
+        if(!isSame)
+        {
+            std::cout << "saving the loaded world gave a different file" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main()
+{
+    bench::initAll();
+    constexpr std::int32_t size = 256;
+    auto world = world::HashlifeWorld::make();
+    bench::generateTerrain(*world, util::Vector3I32(-size / 2), size);
+    if(!measure("terrain", *world->makeSnapshot(), static_cast<double>(size) * size * size))
+        return 1;
+    for(std::int32_t i = 1; i < 8; i++)
+        world->copyRegion(util::Vector3I32(-size / 2),
+                          util::Vector3I32(size / 2 - 1),
+                          util::Vector3I32(-size / 2 + i * size, -size / 2, -size / 2));
+    if(!measure("8 copies of the terrain",
+                *world->makeSnapshot(),
+                8.0 * size * size * size))
+        return 1;
+}
@@ -29,6 +29,7 @@
 #include "../lighting/lighting.h"
 #include "../util/enum.h"
 #include "../util/vector.h"
+#include "../util/constexpr_assert.h"
 
 namespace programmerjake
 {
@@ -146,30 +147,38 @@ struct BlockSummary final
 {
     bool areAllBlocksRenderedLikeAir : 1;
     bool areAllBlocksRenderedLikeBedrock : 1;
+    /** the union of the collision masks of all the blocks; a util::ray_casting::BlockCollisionMask
+     */
+    std::uint32_t collisionMask;
     constexpr bool rendersAnything() const noexcept
     {
         return !areAllBlocksRenderedLikeAir && !areAllBlocksRenderedLikeBedrock;
     }
     constexpr BlockSummary() noexcept : areAllBlocksRenderedLikeAir(false),
-                                        areAllBlocksRenderedLikeBedrock(false)
+                                        areAllBlocksRenderedLikeBedrock(false),
+                                        collisionMask(0)
     {
     }
     constexpr BlockSummary(bool areAllBlocksRenderedLikeAir,
-                           bool areAllBlocksRenderedLikeBedrock) noexcept
+                           bool areAllBlocksRenderedLikeBedrock,
+                           std::uint32_t collisionMask) noexcept
         : areAllBlocksRenderedLikeAir(areAllBlocksRenderedLikeAir),
-          areAllBlocksRenderedLikeBedrock(areAllBlocksRenderedLikeBedrock)
+          areAllBlocksRenderedLikeBedrock(areAllBlocksRenderedLikeBedrock),
+          collisionMask(collisionMask)
     {
     }
     static constexpr BlockSummary makeForEmptyBlockKind() noexcept
     {
         return BlockSummary(
             true,
-            true); // all rendering flags set because we don't render faces against an empty block
+            true, // all rendering flags set because we don't render faces against an empty block
+            0);
     }
     constexpr BlockSummary operator+(const BlockSummary &rt) const noexcept
     {
         return BlockSummary(areAllBlocksRenderedLikeAir && rt.areAllBlocksRenderedLikeAir,
-                            areAllBlocksRenderedLikeBedrock && rt.areAllBlocksRenderedLikeBedrock);
+                            areAllBlocksRenderedLikeBedrock && rt.areAllBlocksRenderedLikeBedrock,
+                            collisionMask | rt.collisionMask);
     }
     BlockSummary &operator+=(const BlockSummary &rt) noexcept
     {
@@ -207,6 +216,175 @@ constexpr util::Vector3I32 getDirection(BlockFace blockFace) noexcept
                             blockFace == BlockFace::NY ? -1 : blockFace == BlockFace::PY ? 1 : 0,
                             blockFace == BlockFace::NZ ? -1 : blockFace == BlockFace::PZ ? 1 : 0);
 }
+
+/** a rotation and/or reflection that maps the axes onto each other.
+ * there are 48 of them: 6 axis permutations times 8 combinations of negated axes.
+ */
+class BlockTransform final
+{
+public:
+    static constexpr std::size_t transformCount = 48;
+
+private:
+    /** index into the permutation table */
+    std::uint8_t permutation;
+    /** bit n is set if output axis n is negated */
+    std::uint8_t negatedAxes;
+    constexpr BlockTransform(std::uint8_t permutation, std::uint8_t negatedAxes) noexcept
+        : permutation(permutation),
+          negatedAxes(negatedAxes)
+    {
+    }
+    static std::uint8_t getInputAxis(std::uint8_t permutation, std::uint8_t outputAxis) noexcept
+    {
+        static constexpr std::uint8_t inputAxes[6][3] = {
+            {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0},
+        };
+        return inputAxes[permutation][outputAxis];
+    }
+    std::uint8_t getInputAxis(std::uint8_t outputAxis) const noexcept
+    {
+        return getInputAxis(permutation, outputAxis);
+    }
+    static std::uint8_t findPermutation(std::uint8_t inputAxisForX,
+                                        std::uint8_t inputAxisForY) noexcept
+    {
+        for(std::uint8_t retval = 0;; retval++)
+        {
+            constexprAssert(retval < 6);
+            if(getInputAxis(retval, 0) == inputAxisForX && getInputAxis(retval, 1) == inputAxisForY)
+                return retval;
+        }
+    }
+    bool isAxisNegated(std::uint8_t outputAxis) const noexcept
+    {
+        return negatedAxes & (1U << outputAxis);
+    }
+    static std::int32_t getComponent(util::Vector3I32 v, std::uint8_t axis) noexcept
+    {
+        return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+    }
+
+public:
+    constexpr BlockTransform() noexcept : permutation(0), negatedAxes(0)
+    {
+    }
+    static constexpr BlockTransform identity() noexcept
+    {
+        return BlockTransform();
+    }
+    static constexpr BlockTransform mirrorX() noexcept
+    {
+        return BlockTransform(0, 1);
+    }
+    static constexpr BlockTransform mirrorY() noexcept
+    {
+        return BlockTransform(0, 2);
+    }
+    static constexpr BlockTransform mirrorZ() noexcept
+    {
+        return BlockTransform(0, 4);
+    }
+    /** rotate 90 degrees counterclockwise looking from +X: Y turns into Z */
+    static constexpr BlockTransform rotateX() noexcept
+    {
+        return BlockTransform(1, 2);
+    }
+    /** rotate 90 degrees counterclockwise looking from +Y: Z turns into X */
+    static constexpr BlockTransform rotateY() noexcept
+    {
+        return BlockTransform(5, 4);
+    }
+    /** rotate 90 degrees counterclockwise looking from +Z: X turns into Y */
+    static constexpr BlockTransform rotateZ() noexcept
+    {
+        return BlockTransform(2, 1);
+    }
+    constexpr std::size_t getIndex() const noexcept
+    {
+        return permutation * 8U + negatedAxes;
+    }
+    static constexpr BlockTransform fromIndex(std::size_t index) noexcept
+    {
+        return (constexprAssert(index < transformCount),
+                BlockTransform(static_cast<std::uint8_t>(index / 8U),
+                               static_cast<std::uint8_t>(index % 8U)));
+    }
+    constexpr bool isIdentity() const noexcept
+    {
+        return permutation == 0 && negatedAxes == 0;
+    }
+    constexpr bool operator==(const BlockTransform &rt) const noexcept
+    {
+        return permutation == rt.permutation && negatedAxes == rt.negatedAxes;
+    }
+    constexpr bool operator!=(const BlockTransform &rt) const noexcept
+    {
+        return !operator==(rt);
+    }
+    /** transform a direction or a position relative to the origin */
+    util::Vector3I32 transformVector(util::Vector3I32 v) const noexcept
+    {
+        util::Vector3I32 retval(getComponent(v, getInputAxis(0)),
+                                getComponent(v, getInputAxis(1)),
+                                getComponent(v, getInputAxis(2)));
+        if(isAxisNegated(0))
+            retval.x = -retval.x;
+        if(isAxisNegated(1))
+            retval.y = -retval.y;
+        if(isAxisNegated(2))
+            retval.z = -retval.z;
+        return retval;
+    }
+    /** transform the position of a block; the block at v fills the cube from v to v + 1, so
+     * reflections map it to -v - 1
+     */
+    util::Vector3I32 transformBlockPosition(util::Vector3I32 v) const noexcept
+    {
+        auto retval = transformVector(v);
+        if(isAxisNegated(0))
+            retval.x--;
+        if(isAxisNegated(1))
+            retval.y--;
+        if(isAxisNegated(2))
+            retval.z--;
+        return retval;
+    }
+    BlockFace transformFace(BlockFace blockFace) const noexcept
+    {
+        auto direction = transformVector(getDirection(blockFace));
+        if(direction.x != 0)
+            return direction.x < 0 ? BlockFace::NX : BlockFace::PX;
+        if(direction.y != 0)
+            return direction.y < 0 ? BlockFace::NY : BlockFace::PY;
+        return direction.z < 0 ? BlockFace::NZ : BlockFace::PZ;
+    }
+    BlockTransform inverse() const noexcept
+    {
+        std::uint8_t outputAxes[3];
+        for(std::uint8_t outputAxis = 0; outputAxis < 3; outputAxis++)
+            outputAxes[getInputAxis(outputAxis)] = outputAxis;
+        std::uint8_t newNegatedAxes = 0;
+        for(std::uint8_t inputAxis = 0; inputAxis < 3; inputAxis++)
+            if(isAxisNegated(outputAxes[inputAxis]))
+                newNegatedAxes |= 1U << inputAxis;
+        return BlockTransform(findPermutation(outputAxes[0], outputAxes[1]), newNegatedAxes);
+    }
+    /** @return the transform that applies b then a */
+    friend BlockTransform operator*(BlockTransform a, BlockTransform b) noexcept
+    {
+        std::uint8_t inputAxes[3];
+        std::uint8_t newNegatedAxes = 0;
+        for(std::uint8_t outputAxis = 0; outputAxis < 3; outputAxis++)
+        {
+            auto intermediateAxis = a.getInputAxis(outputAxis);
+            inputAxes[outputAxis] = b.getInputAxis(intermediateAxis);
+            if(a.isAxisNegated(outputAxis) != b.isAxisNegated(intermediateAxis))
+                newNegatedAxes |= 1U << outputAxis;
+        }
+        return BlockTransform(findPermutation(inputAxes[0], inputAxes[1]), newNegatedAxes);
+    }
+};
 }
 }
 }
@@ -33,6 +33,7 @@ BlockDescriptor::BlockDescriptor(std::string name,
     : lightProperties(lightProperties),
       blockKind(BlockKind::allocate()),
       name(std::move(name)),
+      nameHash(makeNameHash(this->name)),
       blockedFaces(blockedFaces),
       blockSummary(blockSummary)
 {
@@ -41,6 +42,76 @@ BlockDescriptor::BlockDescriptor(std::string name,
         descriptorsLookupTable.resize(blockKind.value * 2);
     descriptorsLookupTable[blockKind.value - 1] = this;
 }
+
+std::uint64_t BlockDescriptor::makeNameHash(const std::string &name) noexcept
+{
+    // 64-bit FNV-1a
+    std::uint64_t retval = 0xCBF29CE484222325ULL;
+    for(unsigned char ch : name)
+    {
+        retval ^= ch;
+        retval *= 0x100000001B3ULL;
+    }
+    return retval;
+}
+
+constexpr std::uint32_t BlockDescriptor::sharedStepVersion;
+constexpr std::uint32_t BlockDescriptor::sharedRenderVersion;
+
+namespace
+{
+/** the 64-bit finalizer from MurmurHash3 */
+std::uint64_t mixFingerprint(std::uint64_t value) noexcept
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    return value ^ (value >> 33);
+}
+}
+
+template <typename GetVersion>
+std::uint64_t BlockDescriptor::makeFingerprint(std::uint32_t sharedVersion,
+                                               GetVersion getVersion) noexcept
+{
+    // summed so it doesn't depend on the order the block descriptors were made in
+    std::uint64_t retval = 0;
+    for(auto descriptor : getDescriptorsLookupTable())
+    {
+        if(descriptor)
+            retval += mixFingerprint(descriptor->nameHash ^ mixFingerprint(getVersion(descriptor)));
+    }
+    return mixFingerprint(retval ^ sharedVersion);
+}
+
+std::uint64_t BlockDescriptor::getStepFingerprint() noexcept
+{
+    return makeFingerprint(sharedStepVersion,
+                           [](const BlockDescriptor *descriptor)
+                           {
+                               return descriptor->getStepVersion();
+                           });
+}
+
+std::uint64_t BlockDescriptor::getRenderFingerprint() noexcept
+{
+    return makeFingerprint(sharedRenderVersion,
+                           [](const BlockDescriptor *descriptor)
+                           {
+                               return descriptor->getRenderVersion();
+                           });
+}
+
+const BlockDescriptor *BlockDescriptor::getByName(const std::string &name) noexcept
+{
+    for(auto descriptor : getDescriptorsLookupTable())
+    {
+        if(descriptor && descriptor->name == name)
+            return descriptor;
+    }
+    return nullptr;
+}
 }
 }
 }
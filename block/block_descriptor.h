@@ -432,6 +432,9 @@ public:
     const lighting::LightProperties lightProperties;
     const BlockKind blockKind;
     const std::string name;
+    /** hash of name that is the same in different processes */
+    const std::uint64_t nameHash;
+    static std::uint64_t makeNameHash(const std::string &name) noexcept;
     const BlockedFaces blockedFaces;
     const BlockSummary blockSummary;
     virtual void render(
@@ -441,6 +444,50 @@ public:
         const util::EnumArray<const lighting::BlockLighting *, BlockFace> &blockLightingForFaces,
         const lighting::BlockLighting &blockLightingForCenter,
         const graphics::Transform &transform) const = 0;
+    /** change the returned value whenever the step functions of this block kind change what
+     * they output, so futures memoized by older code aren't reused
+     */
+    virtual std::uint32_t getStepVersion() const noexcept
+    {
+        return 0;
+    }
+    /** change the returned value whenever render changes what it outputs for this block kind,
+     * including texture coordinates, so meshes cached by older code aren't reused
+     */
+    virtual std::uint32_t getRenderVersion() const noexcept
+    {
+        return 0;
+    }
+    /** the version of the stepping code shared by all block kinds, like lighting and
+     * world::HashlifeWorld::step
+     */
+    static constexpr std::uint32_t sharedStepVersion = 1;
+    /** @return a hash of the names and step versions of all block descriptors, which is the same
+     * in different processes that step blocks the same way
+     */
+    static std::uint64_t getStepFingerprint() noexcept;
+    /** the version of the rendering code shared by all block kinds, like the shapes and vertex
+     * lighting
+     */
+    static constexpr std::uint32_t sharedRenderVersion = 1;
+    /** @return a hash of the names and render versions of all block descriptors, which is the
+     * same in different processes that render blocks the same way
+     */
+    static std::uint64_t getRenderFingerprint() noexcept;
+
+private:
+    template <typename GetVersion>
+    static std::uint64_t makeFingerprint(std::uint32_t sharedVersion,
+                                         GetVersion getVersion) noexcept;
+
+public:
+    /** get the block that block turns into when it is rotated or mirrored by blockTransform.
+     * blocks with an orientation should override this; by default blocks are unchanged.
+     */
+    virtual Block transformBlock(Block block, BlockTransform blockTransform) const
+    {
+        return block;
+    }
     virtual BlockStepPartOutput stepFromNXNYNZ(const BlockStepInput &stepInput,
                                                const BlockStepGlobalState &stepGlobalState) const
     {
@@ -806,6 +853,9 @@ public:
         constexprAssert(blockKind.value < descriptorsLookupTable.size());
         return descriptorsLookupTable[blockKind.value];
     }
+    /** find the block descriptor with the given name
+     * @return the block descriptor or nullptr if there isn't one */
+    static const BlockDescriptor *getByName(const std::string &name) noexcept;
     static BlockStepFullOutput step(const BlockStepInput &stepInput,
                                     const BlockStepGlobalState &stepGlobalState)
     {
@@ -900,12 +950,25 @@ public:
             return lighting::LightProperties::transparent();
         return get(blockKind)->lightProperties;
     }
+    static Block getTransformedBlock(Block block, BlockTransform blockTransform)
+    {
+        if(block.getBlockKind() == BlockKind::empty() || blockTransform.isIdentity())
+            return block;
+        return get(block.getBlockKind())->transformBlock(block, blockTransform);
+    }
     static BlockSummary getBlockSummary(BlockKind blockKind) noexcept
     {
         if(!blockKind)
             return BlockSummary::makeForEmptyBlockKind();
         return get(blockKind)->blockSummary;
     }
+    /** @return 0 for the empty block kind */
+    static std::uint64_t getNameHash(BlockKind blockKind) noexcept
+    {
+        if(!blockKind)
+            return 0;
+        return get(blockKind)->nameHash;
+    }
     static lighting::BlockLighting makeBlockLighting(const BlockStepInput &stepInput,
                                                      const BlockStepGlobalState &stepGlobalState,
                                                      util::Vector3I32 offset) noexcept
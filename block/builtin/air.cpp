@@ -32,7 +32,7 @@ Air::Air()
     : BlockDescriptor("builtin.air",
                       lighting::LightProperties::transparent(),
                       BlockedFaces{{false, false, false, false, false, false}},
-                      BlockSummary(true, false))
+                      BlockSummary(true, false, 0))
 {
 }
 
@@ -23,6 +23,7 @@
 #include "../../graphics/shape/cube.h"
 #include "../../lighting/lighting.h"
 #include "../../resource/resource.h"
+#include "../../util/ray_casting.h"
 
 namespace programmerjake
 {
@@ -37,7 +38,7 @@ Glowstone::Glowstone()
                       lighting::LightProperties::opaque(
                           lighting::Lighting::makeArtificialLighting(lighting::Lighting::maxLight)),
                       BlockedFaces{{true, true, true, true, true, true}},
-                      BlockSummary(false, true)),
+                      BlockSummary(false, true, util::ray_casting::BlockCollisionMaskGround)),
       glowstoneTexture(resource::readResourceTexture("builtin/glowstone.png"))
 {
 }
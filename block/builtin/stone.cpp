@@ -23,6 +23,7 @@
 #include "../../graphics/shape/cube.h"
 #include "../../lighting/lighting.h"
 #include "../../resource/resource.h"
+#include "../../util/ray_casting.h"
 
 namespace programmerjake
 {
@@ -36,7 +37,7 @@ GenericStone::GenericStone(std::string name, graphics::TextureId genericStoneTex
     : BlockDescriptor(name,
                       lighting::LightProperties::opaque(),
                       BlockedFaces{{true, true, true, true, true, true}},
-                      BlockSummary(false, true)),
+                      BlockSummary(false, true, util::ray_casting::BlockCollisionMaskGround)),
       genericStoneTexture(genericStoneTexture)
 {
 }
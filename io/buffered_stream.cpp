@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "buffered_stream.h"
+#include "../util/constexpr_assert.h"
+#include <cstring>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+constexpr std::size_t BufferedInputStream::defaultBufferSize;
+constexpr std::size_t BufferedInputStream::maxVarU64ByteCount;
+constexpr std::size_t BufferedOutputStream::defaultBufferSize;
+constexpr std::size_t BufferedOutputStream::maxVarU64ByteCount;
+
+BufferedInputStream::BufferedInputStream(InputStream &inputStream, std::size_t bufferSize)
+    : inputStream(inputStream), buffer(bufferSize), bufferPosition(0), bufferEnd(0), hitEOF(false)
+{
+    constexprAssert(bufferSize > 0);
+}
+
+BufferedInputStream::ReadBytesResult BufferedInputStream::readBytes(
+    unsigned char *bytes,
+    std::size_t byteCount,
+    const std::chrono::steady_clock::time_point *timeout)
+{
+    std::size_t readCount = 0;
+    while(byteCount > 0)
+    {
+        if(bufferPosition == bufferEnd)
+        {
+            if(hitEOF || (timeout && readCount > 0))
+                break;
+            if(byteCount >= buffer.size())
+            {
+                auto result = inputStream.readBytes(bytes, byteCount, timeout);
+                constexprAssert(result.readCount <= byteCount);
+                hitEOF = result.hitEOF;
+                return ReadBytesResult(readCount + result.readCount, hitEOF);
+            }
+            auto result = inputStream.readBytes(buffer.data(), buffer.size(), timeout);
+            constexprAssert(result.readCount <= buffer.size());
+            bufferPosition = 0;
+            bufferEnd = result.readCount;
+            hitEOF = result.hitEOF;
+            if(bufferEnd == 0 && timeout)
+                break;
+            continue;
+        }
+        std::size_t count = bufferEnd - bufferPosition;
+        if(count > byteCount)
+            count = byteCount;
+        std::memcpy(bytes, buffer.data() + bufferPosition, count);
+        bufferPosition += count;
+        bytes += count;
+        byteCount -= count;
+        readCount += count;
+    }
+    return ReadBytesResult(readCount, hitEOF && bufferPosition == bufferEnd);
+}
+
+BufferedOutputStream::BufferedOutputStream(OutputStream &outputStream, std::size_t bufferSize)
+    : outputStream(outputStream), buffer(bufferSize), bufferPosition(0)
+{
+    constexprAssert(bufferSize >= maxVarU64ByteCount);
+}
+
+void BufferedOutputStream::writeBuffer()
+{
+    if(bufferPosition == 0)
+        return;
+    outputStream.writeBytes(buffer.data(), bufferPosition);
+    bufferPosition = 0;
+}
+
+void BufferedOutputStream::writeBytes(const unsigned char *bytes, std::size_t byteCount)
+{
+    if(byteCount > getFreeByteCount())
+    {
+        writeBuffer();
+        if(byteCount >= buffer.size())
+        {
+            outputStream.writeBytes(bytes, byteCount);
+            return;
+        }
+    }
+    std::memcpy(reserveBufferedBytes(byteCount), bytes, byteCount);
+}
+
+void BufferedOutputStream::flush()
+{
+    writeBuffer();
+    outputStream.flush();
+}
+}
+}
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef IO_BUFFERED_STREAM_H_
+#define IO_BUFFERED_STREAM_H_
+
+#include "input_stream.h"
+#include "output_stream.h"
+#include <vector>
+#include <cstdint>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+/** reads inputStream in blocks of up to bufferSize bytes.
+ * The fixed-width and variable length integer reads are inline and only call readBytes when the
+ * buffer runs out, so call them through BufferedInputStream rather than InputStream to get the
+ * fast path. Reads at least as big as the buffer bypass it.
+ */
+class BufferedInputStream final : public InputStream
+{
+    BufferedInputStream(const BufferedInputStream &) = delete;
+    BufferedInputStream &operator=(const BufferedInputStream &) = delete;
+
+public:
+    static constexpr std::size_t defaultBufferSize = 1UL << 16;
+
+private:
+    static constexpr std::size_t maxVarU64ByteCount = 10;
+
+private:
+    InputStream &inputStream;
+    std::vector<unsigned char> buffer;
+    std::size_t bufferPosition;
+    std::size_t bufferEnd;
+    bool hitEOF;
+
+private:
+    std::size_t getBufferedByteCount() const noexcept
+    {
+        return bufferEnd - bufferPosition;
+    }
+    const unsigned char *consumeBufferedBytes(std::size_t byteCount) noexcept
+    {
+        const unsigned char *retval = buffer.data() + bufferPosition;
+        bufferPosition += byteCount;
+        return retval;
+    }
+
+public:
+    explicit BufferedInputStream(InputStream &inputStream,
+                                 std::size_t bufferSize = defaultBufferSize);
+    using InputStream::readBytes;
+    virtual ReadBytesResult readBytes(
+        unsigned char *bytes,
+        std::size_t byteCount,
+        const std::chrono::steady_clock::time_point *timeout) override;
+    unsigned char readByte()
+    {
+        if(getBufferedByteCount() < 1)
+            return InputStream::readByte();
+        return buffer[bufferPosition++];
+    }
+    bool readBool()
+    {
+        return readByte() != 0;
+    }
+    std::uint8_t readU8()
+    {
+        return readByte();
+    }
+    std::int8_t readS8()
+    {
+        return readU8();
+    }
+    std::uint16_t readU16()
+    {
+        const std::size_t byteCount = 2;
+        if(getBufferedByteCount() < byteCount)
+            return InputStream::readU16();
+        auto bytes = consumeBufferedBytes(byteCount);
+        return (static_cast<std::uint16_t>(bytes[1]) << 8) | bytes[0];
+    }
+    std::int16_t readS16()
+    {
+        return readU16();
+    }
+    std::uint32_t readU32()
+    {
+        const std::size_t byteCount = 4;
+        if(getBufferedByteCount() < byteCount)
+            return InputStream::readU32();
+        auto bytes = consumeBufferedBytes(byteCount);
+        return (static_cast<std::uint32_t>(bytes[3]) << 24)
+               | (static_cast<std::uint32_t>(bytes[2]) << 16)
+               | (static_cast<std::uint32_t>(bytes[1]) << 8) | bytes[0];
+    }
+    std::int32_t readS32()
+    {
+        return readU32();
+    }
+    std::uint64_t readU64()
+    {
+        const std::size_t byteCount = 8;
+        if(getBufferedByteCount() < byteCount)
+            return InputStream::readU64();
+        auto bytes = consumeBufferedBytes(byteCount);
+        return (static_cast<std::uint64_t>(bytes[7]) << 56)
+               | (static_cast<std::uint64_t>(bytes[6]) << 48)
+               | (static_cast<std::uint64_t>(bytes[5]) << 40)
+               | (static_cast<std::uint64_t>(bytes[4]) << 32)
+               | (static_cast<std::uint64_t>(bytes[3]) << 24)
+               | (static_cast<std::uint64_t>(bytes[2]) << 16)
+               | (static_cast<std::uint64_t>(bytes[1]) << 8) | bytes[0];
+    }
+    std::int64_t readS64()
+    {
+        return readU64();
+    }
+    /** read an unsigned LEB128 variable length integer
+     * @throw IOError if it doesn't fit in 64 bits */
+    std::uint64_t readVarU64()
+    {
+        if(getBufferedByteCount() < maxVarU64ByteCount)
+            return InputStream::readVarU64();
+        std::uint64_t retval = 0;
+        for(int shift = 0;; shift += 7)
+        {
+            std::uint8_t byte = buffer[bufferPosition++];
+            if(shift == 63 && byte > 1)
+                throw IOError(std::make_error_code(std::errc::value_too_large),
+                              "variable length integer too big");
+            retval |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0)
+                return retval;
+        }
+    }
+    /** read an unsigned LEB128 variable length integer
+     * @throw IOError if it doesn't fit in 32 bits */
+    std::uint32_t readVarU32()
+    {
+        auto retval = readVarU64();
+        if(retval > std::numeric_limits<std::uint32_t>::max())
+            throw IOError(std::make_error_code(std::errc::value_too_large),
+                          "variable length integer too big");
+        return retval;
+    }
+    float readF32()
+    {
+        union
+        {
+            float f;
+            std::uint32_t i;
+        } u;
+        u.i = readU32();
+        return u.f;
+    }
+    double readF64()
+    {
+        union
+        {
+            double f;
+            std::uint64_t i;
+        } u;
+        u.i = readU64();
+        return u.f;
+    }
+};
+
+/** collects writes into blocks of up to bufferSize bytes before writing them to outputStream.
+ * The fixed-width and variable length integer writes are inline and only call writeBytes when the
+ * buffer is full, so call them through BufferedOutputStream rather than OutputStream to get the
+ * fast path. Writes at least as big as the buffer bypass it.
+ * flush must be called after writing everything.
+ */
+class BufferedOutputStream final : public OutputStream
+{
+    BufferedOutputStream(const BufferedOutputStream &) = delete;
+    BufferedOutputStream &operator=(const BufferedOutputStream &) = delete;
+
+public:
+    static constexpr std::size_t defaultBufferSize = 1UL << 16;
+
+private:
+    static constexpr std::size_t maxVarU64ByteCount = 10;
+
+private:
+    OutputStream &outputStream;
+    std::vector<unsigned char> buffer;
+    std::size_t bufferPosition;
+
+private:
+    void writeBuffer();
+    unsigned char *reserveBufferedBytes(std::size_t byteCount) noexcept
+    {
+        unsigned char *retval = buffer.data() + bufferPosition;
+        bufferPosition += byteCount;
+        return retval;
+    }
+    std::size_t getFreeByteCount() const noexcept
+    {
+        return buffer.size() - bufferPosition;
+    }
+
+public:
+    explicit BufferedOutputStream(OutputStream &outputStream,
+                                  std::size_t bufferSize = defaultBufferSize);
+    virtual void writeBytes(const unsigned char *bytes, std::size_t byteCount) override;
+    /** write the buffered bytes and flush outputStream */
+    virtual void flush() override;
+    void writeByte(unsigned char byte)
+    {
+        if(getFreeByteCount() < 1)
+            writeBuffer();
+        buffer[bufferPosition++] = byte;
+    }
+    void writeBool(bool value)
+    {
+        writeByte(value ? 1 : 0);
+    }
+    void writeU8(std::uint8_t value)
+    {
+        writeByte(value);
+    }
+    void writeS8(std::int8_t value)
+    {
+        writeU8(value);
+    }
+    void writeU16(std::uint16_t value)
+    {
+        const std::size_t byteCount = 2;
+        if(getFreeByteCount() < byteCount)
+            writeBuffer();
+        auto bytes = reserveBufferedBytes(byteCount);
+        bytes[0] = static_cast<std::uint8_t>(value);
+        bytes[1] = static_cast<std::uint8_t>(value >> 8);
+    }
+    void writeS16(std::int16_t value)
+    {
+        writeU16(value);
+    }
+    void writeU32(std::uint32_t value)
+    {
+        const std::size_t byteCount = 4;
+        if(getFreeByteCount() < byteCount)
+            writeBuffer();
+        auto bytes = reserveBufferedBytes(byteCount);
+        bytes[0] = static_cast<std::uint8_t>(value);
+        bytes[1] = static_cast<std::uint8_t>(value >> 8);
+        bytes[2] = static_cast<std::uint8_t>(value >> 16);
+        bytes[3] = static_cast<std::uint8_t>(value >> 24);
+    }
+    void writeS32(std::int32_t value)
+    {
+        writeU32(value);
+    }
+    void writeU64(std::uint64_t value)
+    {
+        const std::size_t byteCount = 8;
+        if(getFreeByteCount() < byteCount)
+            writeBuffer();
+        auto bytes = reserveBufferedBytes(byteCount);
+        bytes[0] = static_cast<std::uint8_t>(value);
+        bytes[1] = static_cast<std::uint8_t>(value >> 8);
+        bytes[2] = static_cast<std::uint8_t>(value >> 16);
+        bytes[3] = static_cast<std::uint8_t>(value >> 24);
+        bytes[4] = static_cast<std::uint8_t>(value >> 32);
+        bytes[5] = static_cast<std::uint8_t>(value >> 40);
+        bytes[6] = static_cast<std::uint8_t>(value >> 48);
+        bytes[7] = static_cast<std::uint8_t>(value >> 56);
+    }
+    void writeS64(std::int64_t value)
+    {
+        writeU64(value);
+    }
+    /** write value as an unsigned LEB128 variable length integer */
+    void writeVarU64(std::uint64_t value)
+    {
+        if(getFreeByteCount() < maxVarU64ByteCount)
+            writeBuffer();
+        while(value >= 0x80)
+        {
+            buffer[bufferPosition++] = static_cast<std::uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        buffer[bufferPosition++] = static_cast<std::uint8_t>(value);
+    }
+    void writeVarU32(std::uint32_t value)
+    {
+        writeVarU64(value);
+    }
+    void writeF32(float value)
+    {
+        union
+        {
+            float f;
+            std::uint32_t i;
+        } u;
+        u.f = value;
+        writeU32(u.i);
+    }
+    void writeF64(double value)
+    {
+        union
+        {
+            double f;
+            std::uint64_t i;
+        } u;
+        u.f = value;
+        writeU64(u.i);
+    }
+};
+}
+}
+}
+
+#endif /* IO_BUFFERED_STREAM_H_ */
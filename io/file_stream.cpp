@@ -20,6 +20,7 @@
  */
 #include "file_stream.h"
 #include <cstdio>
+#include <cerrno>
 #include "../util/text.h"
 #ifdef _WIN32
 #include <wchar.h>
@@ -48,7 +49,8 @@ struct FileInputStream::Implementation final
     }
     ~Implementation()
     {
-        std::fclose(file);
+        if(file)
+            std::fclose(file);
     }
 };
 
@@ -126,11 +128,12 @@ struct FileOutputStream::Implementation final
     }
     ~Implementation()
     {
-        std::fclose(file);
+        if(file)
+            std::fclose(file);
     }
 };
 
-FileOutputStream::FileOutputStream(std::string fileName)
+FileOutputStream::FileOutputStream(std::string fileName, bool append)
 {
 #ifdef _WIN32
     typedef std::wstring FileNameType;
@@ -139,11 +142,11 @@ FileOutputStream::FileOutputStream(std::string fileName)
 #endif
     auto convertedFileName = util::text::stringCast<FileNameType>(fileName);
 #ifdef _WIN32
-    auto *file = ::_wfopen(convertedFileName.c_str(), "wbNS");
+    auto *file = ::_wfopen(convertedFileName.c_str(), append ? "abNS" : "wbNS");
 #elif defined(__linux)
-    auto *file = std::fopen(convertedFileName.c_str(), "wbe");
+    auto *file = std::fopen(convertedFileName.c_str(), append ? "abe" : "wbe");
 #else
-    auto *file = std::fopen(convertedFileName.c_str(), "wb");
+    auto *file = std::fopen(convertedFileName.c_str(), append ? "ab" : "wb");
 #endif
     if(!file)
     {
@@ -188,6 +191,32 @@ void FileOutputStream::close()
     if(implementation)
         implementation->close();
 }
+
+void replaceFile(const std::string &temporaryFileName, const std::string &fileName)
+{
+#ifdef _WIN32
+    typedef std::wstring FileNameType;
+    auto renameFunction = &::_wrename;
+    auto removeFunction = &::_wremove;
+#else
+    typedef std::string FileNameType;
+    auto renameFunction = &std::rename;
+    auto removeFunction = &std::remove;
+#endif
+    auto convertedTemporaryFileName = util::text::stringCast<FileNameType>(temporaryFileName);
+    auto convertedFileName = util::text::stringCast<FileNameType>(fileName);
+    if(renameFunction(convertedTemporaryFileName.c_str(), convertedFileName.c_str()) == 0)
+        return;
+    // some platforms can't rename over an existing file
+    removeFunction(convertedFileName.c_str());
+    if(renameFunction(convertedTemporaryFileName.c_str(), convertedFileName.c_str()) != 0)
+    {
+        int error = errno;
+        throw IOError(error,
+                      std::generic_category(),
+                      "can't rename " + temporaryFileName + " to " + fileName);
+    }
+}
 }
 }
 }
@@ -71,7 +71,9 @@ private:
     Implementation *implementation;
 
 public:
-    explicit FileOutputStream(std::string fileName);
+    /** @param append if the file is written after its current contents instead of replacing it
+     */
+    explicit FileOutputStream(std::string fileName, bool append = false);
     virtual ~FileOutputStream();
     FileOutputStream(FileOutputStream &&rt) noexcept : OutputStream(std::move(rt)),
                                                        implementation(rt.implementation)
@@ -88,6 +90,10 @@ public:
     virtual void flush() override;
     void close();
 };
+
+/** rename temporaryFileName to fileName, replacing fileName if it exists
+ * @throw IOError if it can't be renamed */
+void replaceFile(const std::string &temporaryFileName, const std::string &fileName);
 }
 }
 }
@@ -140,6 +140,32 @@ struct InputStream : virtual public StreamBase
     {
         return readU64();
     }
+    /** read an unsigned LEB128 variable length integer
+     * @throw IOError if it doesn't fit in 64 bits */
+    std::uint64_t readVarU64()
+    {
+        std::uint64_t retval = 0;
+        for(int shift = 0;; shift += 7)
+        {
+            std::uint8_t byte = readU8();
+            if(shift == 63 && byte > 1)
+                throw IOError(std::make_error_code(std::errc::value_too_large),
+                              "variable length integer too big");
+            retval |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0)
+                return retval;
+        }
+    }
+    /** read an unsigned LEB128 variable length integer
+     * @throw IOError if it doesn't fit in 32 bits */
+    std::uint32_t readVarU32()
+    {
+        auto retval = readVarU64();
+        if(retval > std::numeric_limits<std::uint32_t>::max())
+            throw IOError(std::make_error_code(std::errc::value_too_large),
+                          "variable length integer too big");
+        return retval;
+    }
     float readF32()
     {
         static_assert(
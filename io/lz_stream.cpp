@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "lz_stream.h"
+#include "../util/constexpr_assert.h"
+#include <cstring>
+#include <system_error>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+constexpr std::size_t LZ::chunkSize;
+constexpr std::size_t LZ::minimumMatchLength;
+constexpr std::size_t LZ::maximumCompressedChunkSize;
+
+/* each sequence is a token byte, the literal length if it doesn't fit in the token, the
+ * literals, then, unless the sequence is the last one in the chunk, a u16 match offset and the
+ * match length if it doesn't fit in the token.
+ * the token has the literal length in the high 4 bits and the match length minus
+ * minimumMatchLength in the low 4 bits; a length of 15 is continued in the following bytes,
+ * each adding up to 255, stopping after the first byte that isn't 255.
+ */
+namespace
+{
+constexpr int hashTableLogBase2OfSize = 14;
+constexpr std::size_t tokenLengthMask = 0xF;
+
+std::uint32_t read32(const unsigned char *bytes) noexcept
+{
+    std::uint32_t retval;
+    std::memcpy(&retval, bytes, sizeof(retval));
+    return retval;
+}
+
+std::size_t hash32(std::uint32_t value) noexcept
+{
+    return static_cast<std::uint32_t>(value * 2654435761UL) >> (32 - hashTableLogBase2OfSize);
+}
+
+void writeLength(std::size_t length, std::vector<unsigned char> &output)
+{
+    while(length >= 0xFF)
+    {
+        output.push_back(0xFF);
+        length -= 0xFF;
+    }
+    output.push_back(length);
+}
+
+IOError makeInvalidCompressedDataError()
+{
+    return IOError(std::make_error_code(std::errc::illegal_byte_sequence),
+                   "invalid compressed data");
+}
+
+std::size_t readLength(const unsigned char *&input, const unsigned char *inputEnd)
+{
+    std::size_t retval = 0;
+    while(true)
+    {
+        if(input == inputEnd)
+            throw makeInvalidCompressedDataError();
+        auto byte = *input++;
+        retval += byte;
+        if(byte != 0xFF)
+            return retval;
+    }
+}
+}
+
+void LZ::compressChunk(const unsigned char *input,
+                       std::size_t inputSize,
+                       std::vector<unsigned char> &output)
+{
+    constexprAssert(inputSize <= chunkSize);
+    std::vector<std::uint32_t> hashTable(1UL << hashTableLogBase2OfSize, 0);
+    std::size_t literalStart = 0;
+    std::size_t position = 0;
+    auto writeSequence = [&](std::size_t matchOffset, std::size_t matchLength)
+    {
+        std::size_t literalLength = position - literalStart;
+        bool hasMatch = matchLength != 0;
+        std::size_t tokenMatchLength = hasMatch ? matchLength - minimumMatchLength : 0;
+        output.push_back(
+            (std::min(literalLength, tokenLengthMask) << 4)
+            | std::min(tokenMatchLength, tokenLengthMask));
+        if(literalLength >= tokenLengthMask)
+            writeLength(literalLength - tokenLengthMask, output);
+        output.insert(output.end(), input + literalStart, input + position);
+        if(hasMatch)
+        {
+            output.push_back(matchOffset & 0xFF);
+            output.push_back(matchOffset >> 8);
+            if(tokenMatchLength >= tokenLengthMask)
+                writeLength(tokenMatchLength - tokenLengthMask, output);
+        }
+    };
+    while(inputSize >= minimumMatchLength && position <= inputSize - minimumMatchLength)
+    {
+        auto value = read32(input + position);
+        auto &hashTableEntry = hashTable[hash32(value)];
+        std::size_t candidate = hashTableEntry;
+        hashTableEntry = position;
+        if(candidate >= position || position - candidate > 0xFFFF
+           || read32(input + candidate) != value)
+        {
+            position++;
+            continue;
+        }
+        std::size_t matchLength = minimumMatchLength;
+        while(position + matchLength < inputSize
+              && input[candidate + matchLength] == input[position + matchLength])
+            matchLength++;
+        writeSequence(position - candidate, matchLength);
+        position += matchLength;
+        literalStart = position;
+    }
+    position = inputSize;
+    writeSequence(0, 0);
+}
+
+void LZ::decompressChunk(const unsigned char *input,
+                         std::size_t inputSize,
+                         unsigned char *output,
+                         std::size_t outputSize)
+{
+    auto inputEnd = input + inputSize;
+    std::size_t outputPosition = 0;
+    while(true)
+    {
+        if(input == inputEnd)
+            throw makeInvalidCompressedDataError();
+        unsigned char token = *input++;
+        std::size_t literalLength = token >> 4;
+        if(literalLength == tokenLengthMask)
+            literalLength += readLength(input, inputEnd);
+        if(literalLength > static_cast<std::size_t>(inputEnd - input)
+           || literalLength > outputSize - outputPosition)
+            throw makeInvalidCompressedDataError();
+        std::memcpy(output + outputPosition, input, literalLength);
+        input += literalLength;
+        outputPosition += literalLength;
+        if(input == inputEnd)
+            break;
+        if(inputEnd - input < 2)
+            throw makeInvalidCompressedDataError();
+        std::size_t matchOffset = input[0] | (static_cast<std::size_t>(input[1]) << 8);
+        input += 2;
+        std::size_t matchLength = (token & tokenLengthMask) + minimumMatchLength;
+        if((token & tokenLengthMask) == tokenLengthMask)
+            matchLength += readLength(input, inputEnd);
+        if(matchOffset == 0 || matchOffset > outputPosition
+           || matchLength > outputSize - outputPosition)
+            throw makeInvalidCompressedDataError();
+        auto matchSource = output + outputPosition - matchOffset;
+        if(matchOffset >= matchLength)
+        {
+            std::memcpy(output + outputPosition, matchSource, matchLength);
+        }
+        else
+        {
+            // the match overlaps the bytes it produces, so copy one byte at a time
+            for(std::size_t i = 0; i < matchLength; i++)
+                output[outputPosition + i] = matchSource[i];
+        }
+        outputPosition += matchLength;
+    }
+    if(outputPosition != outputSize)
+        throw makeInvalidCompressedDataError();
+}
+
+void LZCompressingOutputStream::writeChunk()
+{
+    if(buffer.empty())
+        return;
+    compressedBuffer.clear();
+    LZ::compressChunk(buffer.data(), buffer.size(), compressedBuffer);
+    outputStream.writeU32(buffer.size());
+    outputStream.writeU32(compressedBuffer.size());
+    outputStream.writeBytes(compressedBuffer.data(), compressedBuffer.size());
+    buffer.clear();
+}
+
+void LZCompressingOutputStream::writeBytes(const unsigned char *bytes, std::size_t byteCount)
+{
+    while(byteCount > 0)
+    {
+        std::size_t count = LZ::chunkSize - buffer.size();
+        if(count > byteCount)
+            count = byteCount;
+        buffer.insert(buffer.end(), bytes, bytes + count);
+        bytes += count;
+        byteCount -= count;
+        if(buffer.size() == LZ::chunkSize)
+            writeChunk();
+    }
+}
+
+void LZCompressingOutputStream::flush()
+{
+    writeChunk();
+    outputStream.flush();
+}
+
+void LZCompressingOutputStream::finish()
+{
+    writeChunk();
+    outputStream.writeU32(0);
+    outputStream.writeU32(0);
+    outputStream.flush();
+}
+
+void LZDecompressingInputStream::readChunk()
+{
+    std::size_t size = inputStream.readU32();
+    std::size_t compressedSize = inputStream.readU32();
+    if(size == 0)
+    {
+        hitEnd = true;
+        buffer.clear();
+        bufferPosition = 0;
+        return;
+    }
+    if(size > LZ::chunkSize || compressedSize > LZ::maximumCompressedChunkSize)
+        throw makeInvalidCompressedDataError();
+    compressedBuffer.resize(compressedSize);
+    inputStream.readAllBytes(compressedBuffer.data(), compressedSize);
+    buffer.resize(size);
+    LZ::decompressChunk(compressedBuffer.data(), compressedSize, buffer.data(), size);
+    bufferPosition = 0;
+}
+
+LZDecompressingInputStream::ReadBytesResult LZDecompressingInputStream::readBytes(
+    unsigned char *bytes,
+    std::size_t byteCount,
+    const std::chrono::steady_clock::time_point *)
+{
+    std::size_t readCount = 0;
+    while(byteCount > 0)
+    {
+        if(bufferPosition == buffer.size())
+        {
+            if(hitEnd)
+                return ReadBytesResult(readCount, true);
+            readChunk();
+            continue;
+        }
+        std::size_t count = buffer.size() - bufferPosition;
+        if(count > byteCount)
+            count = byteCount;
+        std::memcpy(bytes, buffer.data() + bufferPosition, count);
+        bufferPosition += count;
+        bytes += count;
+        byteCount -= count;
+        readCount += count;
+    }
+    return ReadBytesResult(readCount, false);
+}
+}
+}
+}
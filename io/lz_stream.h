@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef IO_LZ_STREAM_H_
+#define IO_LZ_STREAM_H_
+
+#include "input_stream.h"
+#include "output_stream.h"
+#include <vector>
+#include <cstdint>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+/** a simple LZ77 compressor, similar to LZ4.
+ * The data is split into independently compressed chunks of up to chunkSize bytes, each written
+ * as a u32 uncompressed size, a u32 compressed size, and the compressed bytes. A chunk with an
+ * uncompressed size of 0 ends the stream.
+ */
+struct LZ final
+{
+    static constexpr std::size_t chunkSize = 1UL << 16;
+    static constexpr std::size_t minimumMatchLength = 4;
+    /** the most compressChunk can write for a chunk of up to chunkSize bytes */
+    static constexpr std::size_t maximumCompressedChunkSize = chunkSize + chunkSize / 255 + 16;
+    /** compress input and append it to output */
+    static void compressChunk(const unsigned char *input,
+                              std::size_t inputSize,
+                              std::vector<unsigned char> &output);
+    /** decompress a chunk made by compressChunk
+     * @throw IOError if input isn't valid or doesn't decompress to outputSize bytes */
+    static void decompressChunk(const unsigned char *input,
+                                std::size_t inputSize,
+                                unsigned char *output,
+                                std::size_t outputSize);
+};
+
+/** compresses everything written to it and writes it to outputStream.
+ * finish must be called after writing everything. */
+class LZCompressingOutputStream final : public OutputStream
+{
+private:
+    OutputStream &outputStream;
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> compressedBuffer;
+
+private:
+    void writeChunk();
+
+public:
+    explicit LZCompressingOutputStream(OutputStream &outputStream)
+        : outputStream(outputStream), buffer(), compressedBuffer()
+    {
+        buffer.reserve(LZ::chunkSize);
+    }
+    virtual void writeBytes(const unsigned char *bytes, std::size_t byteCount) override;
+    virtual void flush() override;
+    /** write the rest of the data and the end of the compressed stream */
+    void finish();
+};
+
+/** reads a compressed stream written by LZCompressingOutputStream from inputStream.
+ * Stops reading from inputStream after the end of the compressed stream. */
+class LZDecompressingInputStream final : public InputStream
+{
+private:
+    InputStream &inputStream;
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> compressedBuffer;
+    std::size_t bufferPosition;
+    bool hitEnd;
+
+private:
+    void readChunk();
+
+public:
+    explicit LZDecompressingInputStream(InputStream &inputStream)
+        : inputStream(inputStream),
+          buffer(),
+          compressedBuffer(),
+          bufferPosition(0),
+          hitEnd(false)
+    {
+    }
+    virtual ReadBytesResult readBytes(
+        unsigned char *bytes,
+        std::size_t byteCount,
+        const std::chrono::steady_clock::time_point *timeout) override;
+};
+}
+}
+}
+
+#endif /* IO_LZ_STREAM_H_ */
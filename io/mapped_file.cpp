@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "mapped_file.h"
+#include "file_stream.h"
+#include <vector>
+#if defined(__linux) || defined(__unix) || defined(__APPLE__)
+#define PROGRAMMERJAKE_VOXELS_IO_MAPPED_FILE_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+#ifdef PROGRAMMERJAKE_VOXELS_IO_MAPPED_FILE_USE_MMAP
+struct MappedFile::Implementation final
+{
+    void *memory;
+    std::size_t memorySize;
+    Implementation(void *memory, std::size_t memorySize) : memory(memory), memorySize(memorySize)
+    {
+    }
+    ~Implementation()
+    {
+        if(memorySize != 0)
+            ::munmap(memory, memorySize);
+    }
+};
+
+MappedFile::MappedFile(std::string fileName)
+    : implementation(nullptr), memory(nullptr), memorySize(0)
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        int error = errno;
+        throw IOError(error, std::generic_category(), "open failed: " + std::move(fileName));
+    }
+    struct ::stat statBuffer;
+    if(::fstat(fd, &statBuffer) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw IOError(error, std::generic_category(), "fstat failed");
+    }
+    std::size_t fileSize = statBuffer.st_size;
+    void *mappedMemory = nullptr;
+    if(fileSize != 0)
+    {
+        mappedMemory = ::mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if(mappedMemory == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(fd);
+            throw IOError(error, std::generic_category(), "mmap failed");
+        }
+    }
+    ::close(fd);
+    try
+    {
+        implementation = new Implementation(mappedMemory, fileSize);
+    }
+    catch(...)
+    {
+        if(fileSize != 0)
+            ::munmap(mappedMemory, fileSize);
+        throw;
+    }
+    memory = static_cast<const unsigned char *>(mappedMemory);
+    memorySize = fileSize;
+}
+#else
+struct MappedFile::Implementation final
+{
+    std::vector<unsigned char> memory;
+};
+
+MappedFile::MappedFile(std::string fileName)
+    : implementation(new Implementation), memory(nullptr), memorySize(0)
+{
+    try
+    {
+        FileInputStream is(std::move(fileName));
+        const std::size_t chunkSize = 1 << 16;
+        while(true)
+        {
+            auto oldSize = implementation->memory.size();
+            implementation->memory.resize(oldSize + chunkSize);
+            auto result = is.readBytes(implementation->memory.data() + oldSize, chunkSize);
+            implementation->memory.resize(oldSize + result.readCount);
+            if(result.hitEOF)
+                break;
+        }
+    }
+    catch(...)
+    {
+        delete implementation;
+        throw;
+    }
+    memory = implementation->memory.data();
+    memorySize = implementation->memory.size();
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+    delete implementation;
+}
+}
+}
+}
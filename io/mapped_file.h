@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef IO_MAPPED_FILE_H_
+#define IO_MAPPED_FILE_H_
+
+#include "stream_base.h"
+#include <string>
+#include <cstddef>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace io
+{
+/** a read-only file mapped into memory. On platforms without memory mapping the whole file is
+ * read into memory instead. */
+class MappedFile final
+{
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+private:
+    struct Implementation;
+
+private:
+    Implementation *implementation;
+    const unsigned char *memory;
+    std::size_t memorySize;
+
+public:
+    explicit MappedFile(std::string fileName);
+    ~MappedFile();
+    const unsigned char *data() const noexcept
+    {
+        return memory;
+    }
+    std::size_t size() const noexcept
+    {
+        return memorySize;
+    }
+};
+}
+}
+}
+
+#endif /* IO_MAPPED_FILE_H_ */
@@ -26,6 +26,7 @@
 #include "output_stream.h"
 #include <memory>
 #include <vector>
+#include <cstring>
 
 namespace programmerjake
 {
@@ -67,12 +68,15 @@ public:
     {
         if(bufferSize > memoryBufferSize - position)
             bufferSize = memoryBufferSize - position;
-        for(std::size_t i = 0; i < bufferSize; i++)
-        {
-            buffer[i] = memoryBuffer.get()[position++];
-        }
+        std::memcpy(buffer, memoryBuffer.get() + position, bufferSize);
+        position += bufferSize;
         return ReadBytesResult(bufferSize, position >= memoryBufferSize);
     }
+    /** the number of bytes that haven't been read yet */
+    std::size_t getRemainingSize() const noexcept
+    {
+        return memoryBufferSize - position;
+    }
 };
 
 class MemoryOutputStream final : public OutputStream
@@ -101,6 +101,24 @@ struct OutputStream : virtual public StreamBase
     {
         writeU64(value);
     }
+    /** write value as an unsigned LEB128 variable length integer */
+    void writeVarU64(std::uint64_t value)
+    {
+        const std::size_t maxByteCount = 10;
+        std::uint8_t bytes[maxByteCount];
+        std::size_t byteCount = 0;
+        while(value >= 0x80)
+        {
+            bytes[byteCount++] = static_cast<std::uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        bytes[byteCount++] = static_cast<std::uint8_t>(value);
+        writeBytes(bytes, byteCount);
+    }
+    void writeVarU32(std::uint32_t value)
+    {
+        writeVarU64(value);
+    }
     void writeF32(float value)
     {
         static_assert(
@@ -19,6 +19,7 @@
  *
  */
 #include "world/world.h"
+#include "world/mesh_cache.h"
 #include "world/init.h"
 #include "block/block_descriptor.h"
 #include "util/enum.h"
@@ -35,6 +36,7 @@
 #include "block/builtin/cobblestone.h"
 #include "threading/threading.h"
 #include "graphics/shape/cube.h"
+#include "util/ray_casting.h"
 #include <sstream>
 #include <iostream>
 #include <chrono>
@@ -60,7 +62,7 @@ struct MyBlock final : public block::BlockDescriptor
               lighting::LightProperties::opaque(lighting::Lighting::makeArtificialLighting(
                   state >= stateCount / 2 ? lighting::Lighting::maxLight : 0)),
               BlockedFaces{{true, true, true, true, true, true}},
-              block::BlockSummary(false, true)),
+              block::BlockSummary(false, true, util::ray_casting::BlockCollisionMaskGround)),
           state(state)
     {
     }
@@ -314,6 +316,7 @@ int main()
         generateRenderBuffersWorkList;
     bool generateRenderBuffersDone = false;
     std::list<threading::Thread> generateRenderBuffersThreads;
+    world::MeshCache meshCache("mesh_cache.bin");
     const float nearPlane = 0.01f;
     const float farPlane = 200;
     world::HashlifeWorld::GPURenderBufferCache gpuRenderBufferCache;
@@ -368,7 +371,7 @@ int main()
                                 auto key = std::move(generateRenderBuffersWorkList.front());
                                 generateRenderBuffersWorkList.pop_front();
                                 lockIt.unlock();
-                                auto result = world::HashlifeWorld::renderRenderCacheEntry(key);
+                                auto result = meshCache.renderRenderCacheEntry(key);
                                 lockIt.lock();
                                 generateRenderBuffersMap[key].renderBuffer = std::move(result);
                                 generateRenderBuffersCond.notify_all();
@@ -403,6 +406,10 @@ int main()
                                     ss << " " << generateRenderBuffersWorkList.size() << " "
                                        << generateRenderBuffersMap.size();
                                 }
+                                auto periodStatistics = theWorld->getPeriodStatistics();
+                                ss << " still: " << periodStatistics.stillNodeCount
+                                   << " periodic: " << periodStatistics.stillSnapshotCount << " "
+                                   << periodStatistics.oscillatingSnapshotCount;
                                 tickCount = 0;
                                 logging::log(logging::Level::Info, "main", ss.str());
                             }
@@ -619,6 +626,16 @@ int main()
     }
     if(mainGameLoopThread.joinable())
         mainGameLoopThread.join();
+    try
+    {
+        meshCache.save();
+    }
+    catch(io::IOError &e)
+    {
+        logging::log(logging::Level::Warning,
+                     "main",
+                     std::string("can't save mesh cache: ") + e.what());
+    }
     return 0;
 }
 }
@@ -22,6 +22,8 @@
 #include "../io/file_stream.h"
 #include "../graphics/image.h"
 #include "../graphics/texture.h"
+#include <unordered_map>
+#include <mutex>
 
 namespace programmerjake
 {
@@ -39,9 +41,49 @@ std::shared_ptr<graphics::Image> readResourceImage(std::string name)
     return graphics::Image::load(readResource(std::move(name)));
 }
 
+namespace
+{
+struct ResourceTextureNames final
+{
+    std::mutex lock;
+    std::unordered_map<graphics::TextureImplementation *, std::string> names;
+    std::unordered_map<std::string, graphics::TextureId> textures;
+    static ResourceTextureNames &get()
+    {
+        static ResourceTextureNames *retval = new ResourceTextureNames;
+        return *retval;
+    }
+};
+}
+
 graphics::TextureId readResourceTexture(std::string name)
 {
-    return graphics::TextureId::makeTexture(readResourceImage(std::move(name)));
+    auto retval = graphics::TextureId::makeTexture(readResourceImage(name));
+    auto &resourceTextureNames = ResourceTextureNames::get();
+    std::unique_lock<std::mutex> lockIt(resourceTextureNames.lock);
+    resourceTextureNames.names[retval.value] = name;
+    resourceTextureNames.textures[std::move(name)] = retval;
+    return retval;
+}
+
+std::string getResourceTextureName(graphics::TextureId texture)
+{
+    auto &resourceTextureNames = ResourceTextureNames::get();
+    std::unique_lock<std::mutex> lockIt(resourceTextureNames.lock);
+    auto iter = resourceTextureNames.names.find(texture.value);
+    if(iter == resourceTextureNames.names.end())
+        return std::string();
+    return std::get<1>(*iter);
+}
+
+graphics::TextureId findResourceTexture(const std::string &name)
+{
+    auto &resourceTextureNames = ResourceTextureNames::get();
+    std::unique_lock<std::mutex> lockIt(resourceTextureNames.lock);
+    auto iter = resourceTextureNames.textures.find(name);
+    if(iter == resourceTextureNames.textures.end())
+        return graphics::TextureId();
+    return std::get<1>(*iter);
 }
 }
 }
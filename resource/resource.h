@@ -43,6 +43,12 @@ namespace resource
 std::shared_ptr<io::InputStream> readResource(std::string name);
 std::shared_ptr<graphics::Image> readResourceImage(std::string name);
 graphics::TextureId readResourceTexture(std::string name);
+/** @return the name texture was read from by readResourceTexture, or the empty string if it
+ * wasn't made by readResourceTexture */
+std::string getResourceTextureName(graphics::TextureId texture);
+/** @return the texture made by readResourceTexture from name, or an empty TextureId if there
+ * isn't one */
+graphics::TextureId findResourceTexture(const std::string &name);
 }
 }
 }
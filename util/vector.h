@@ -64,7 +64,7 @@ struct VectorImplementation final
                                 I>::type
         constexprFloor(F v)
     {
-        return v < 0 ? static_cast<I>(-static_cast<I>(-v)) : static_cast<I>(v);
+        return static_cast<I>(v) > v ? static_cast<I>(v) - 1 : static_cast<I>(v);
     }
     template <typename To,
               typename From,
@@ -41,6 +41,17 @@ std::vector<Dimension::Properties> *Dimension::makePropertiesLookupTable() noexc
     return retval;
 }
 
+util::Optional<Dimension> Dimension::getByName(const std::string &name) noexcept
+{
+    auto &propertiesLookupTable = getPropertiesLookupTable();
+    for(std::size_t i = 0; i < propertiesLookupTable.size(); i++)
+    {
+        if(propertiesLookupTable[i].name == name)
+            return Dimension(i);
+    }
+    return util::nullOpt;
+}
+
 void Dimension::handleTooManyDimensions() noexcept
 {
     logging::log(logging::Level::Fatal, "Dimension", "out of Dimension values");
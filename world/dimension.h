@@ -104,6 +104,9 @@ public:
     {
         getPropertiesLookupTable();
     }
+    /** find the dimension with the given name
+     * @return the dimension or nullOpt if there isn't one */
+    static util::Optional<Dimension> getByName(const std::string &name) noexcept;
     const Properties &getProperties() const noexcept
     {
         return getPropertiesLookupTable()[value];
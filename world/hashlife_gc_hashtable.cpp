@@ -31,6 +31,7 @@ void HashlifeGarbageCollectedHashtable::garbageCollect(
 {
     if(!needGarbageCollect(garbageCollectTargetNodeCount))
         return;
+    canonicalUniformNodes.clear();
     std::size_t numberOfNodesLeftToCollect = nodeCount - garbageCollectTargetNodeCount;
     for(std::size_t collectedCount = 1; collectedCount > 0;)
     {
@@ -28,6 +28,7 @@
 #include <vector>
 #include "../util/constexpr_array.h"
 #include <list>
+#include <unordered_map>
 
 namespace programmerjake
 {
@@ -52,6 +53,14 @@ private:
     std::size_t nodeCount;
     HashlifeNodeReference<const HashlifeNodeBase, false>
         canonicalEmptyNodes[HashlifeNodeBase::maxLevel + 1];
+    /** canonical nodes filled with a single non-empty block.
+     * @note
+     * cleared when garbage collecting so the nodes for blocks that aren't used anymore can be
+     * freed
+     */
+    std::unordered_map<block::Block,
+                       util::Array<HashlifeNodeReference<const HashlifeNodeBase, false>,
+                                   levelCount>> canonicalUniformNodes;
 
 private:
     static constexpr std::size_t getBucketIndex(std::size_t hash, HashlifeNodeBase::LevelType level)
@@ -136,7 +145,8 @@ private:
     }
 
 public:
-    HashlifeGarbageCollectedHashtable() : buckets(), nodeCount(0), canonicalEmptyNodes{}
+    HashlifeGarbageCollectedHashtable()
+        : buckets(), nodeCount(0), canonicalEmptyNodes{}, canonicalUniformNodes()
     {
         buckets.resize(bucketCountPerLevel * levelCount, nullptr);
     }
@@ -202,8 +212,53 @@ public:
         }
         return canonicalEmptyNodes[level];
     }
+    /** get the canonical node of the specified level that is filled with block
+     */
+    const HashlifeNodeReference<const HashlifeNodeBase, false> &getCanonicalUniformNode(
+        block::Block block, HashlifeNodeBase::LevelType level)
+    {
+        constexprAssert(level <= HashlifeNodeBase::maxLevel);
+        if(block == block::Block())
+            return getCanonicalEmptyNode(level);
+        auto &nodes = canonicalUniformNodes[block];
+        if(!nodes[level])
+        {
+            if(HashlifeNodeBase::isLeaf(level))
+            {
+                nodes[level] = findOrAddNode(HashlifeLeafNode::BlocksArray{
+                    block, block, block, block, block, block, block, block});
+            }
+            else
+            {
+                auto childNode = getCanonicalUniformNode(block, level - 1);
+                nodes[level] = findOrAddNode(HashlifeNonleafNode::ChildNodesArray{childNode,
+                                                                                  childNode,
+                                                                                  childNode,
+                                                                                  childNode,
+                                                                                  childNode,
+                                                                                  childNode,
+                                                                                  childNode,
+                                                                                  childNode});
+            }
+        }
+        return nodes[level];
+    }
     static constexpr std::size_t defaultGarbageCollectTargetNodeCount =
         1UL << 20; // 1M nodes or about 64MiB
+    std::size_t getNodeCount() const noexcept
+    {
+        return nodeCount;
+    }
+    /** call fn with each node in this hashtable, including ones that aren't used anymore */
+    template <typename Fn>
+    void forEachNode(Fn &&fn) const
+    {
+        for(const HashlifeNodeBase *node : buckets)
+        {
+            for(; node != nullptr; node = node->hashNext)
+                fn(node);
+        }
+    }
     bool needGarbageCollect(
         std::size_t garbageCollectTargetNodeCount = defaultGarbageCollectTargetNodeCount) noexcept
     {
@@ -19,3 +19,61 @@
  *
  */
 #include "hashlife_node.h"
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace world
+{
+void HashlifeNodeBase::addBlockKindCounts(HashlifeBlockKindCounts &blockKindCounts) const
+{
+    if(isUniform)
+    {
+        auto blockCount = std::numeric_limits<HashlifeBlockKindCounts::CountType>::max();
+        auto log2BlockCount = 3 * (level + 1);
+        if(log2BlockCount < std::numeric_limits<HashlifeBlockKindCounts::CountType>::digits)
+            blockCount = static_cast<HashlifeBlockKindCounts::CountType>(1) << log2BlockCount;
+        blockKindCounts.add(uniformBlock.getBlockKind(), blockCount);
+        return;
+    }
+    static_assert(levelSize == 2, "");
+    auto addChildCounts = [this](HashlifeBlockKindCounts &blockKindCounts)
+    {
+        for(util::Vector3I32 index(0); index.x < levelSize; index.x++)
+        {
+            for(index.y = 0; index.y < levelSize; index.y++)
+            {
+                for(index.z = 0; index.z < levelSize; index.z++)
+                {
+                    if(isLeaf())
+                        blockKindCounts.add(getAsLeaf(this)->getBlock(index).getBlockKind(), 1);
+                    else
+                        getAsNonleaf(this)->getChildNode(index)->addBlockKindCounts(
+                            blockKindCounts);
+                }
+            }
+        }
+    };
+    // nodes just above the leaves are the most common, so don't spend memory memoizing them
+    if(level <= 1)
+    {
+        addChildCounts(blockKindCounts);
+        return;
+    }
+    auto nonleafNode = getAsNonleaf(this);
+    auto *cachedValue = nonleafNode->cachedBlockKindCounts.value.load(std::memory_order_acquire);
+    if(!cachedValue)
+    {
+        std::unique_ptr<HashlifeBlockKindCounts> newValue(new HashlifeBlockKindCounts);
+        addChildCounts(*newValue);
+        // another thread could have filled it in first; its value is identical, so keep that one
+        if(nonleafNode->cachedBlockKindCounts.value.compare_exchange_strong(
+               cachedValue, newValue.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+            cachedValue = newValue.release();
+    }
+    blockKindCounts.add(*cachedValue);
+}
+}
+}
+}
@@ -34,6 +34,11 @@
 #include <cstdint>
 #include <atomic>
 #include <utility>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <initializer_list>
 
 namespace programmerjake
 {
@@ -254,6 +259,47 @@ public:
     }
 };
 
+/** the number of blocks of each kind, sorted by kind.
+ * counts saturate instead of overflowing, since the root can hold more than 2^64 blocks.
+ */
+struct HashlifeBlockKindCounts final
+{
+    typedef std::uint64_t CountType;
+    std::vector<std::pair<block::BlockKind, CountType>> counts;
+    static CountType addCounts(CountType a, CountType b) noexcept
+    {
+        return a > std::numeric_limits<CountType>::max() - b ?
+                   std::numeric_limits<CountType>::max() :
+                   a + b;
+    }
+    static CountType multiplyCounts(CountType a, CountType b) noexcept
+    {
+        return b != 0 && a > std::numeric_limits<CountType>::max() / b ?
+                   std::numeric_limits<CountType>::max() :
+                   a * b;
+    }
+    void add(block::BlockKind blockKind, CountType count)
+    {
+        auto iter = std::lower_bound(counts.begin(),
+                                     counts.end(),
+                                     blockKind,
+                                     [](const std::pair<block::BlockKind, CountType> &a,
+                                        block::BlockKind b)
+                                     {
+                                         return block::BlockKindLess()(a.first, b);
+                                     });
+        if(iter != counts.end() && iter->first == blockKind)
+            iter->second = addCounts(iter->second, count);
+        else
+            counts.insert(iter, std::make_pair(blockKind, count));
+    }
+    void add(const HashlifeBlockKindCounts &rt)
+    {
+        for(auto &count : rt.counts)
+            add(count.first, count.second);
+    }
+};
+
 struct HashlifeNonleafNode;
 struct HashlifeLeafNode;
 class HashlifeNodeBase
@@ -285,7 +331,60 @@ public:
     typedef std::uint8_t LevelType;
     static constexpr LevelType maxLevel = 32 - 2;
     const LevelType level;
+    /** true if every block in this node is uniformBlock */
+    const bool isUniform;
+    /** true if this node is a stub: it stands in for a subtree that isn't in memory, so its
+     * children aren't its blocks and must not be read. It has the level, blockSummary,
+     * blockKindPresenceMask and contentHash of the subtree, or values that are conservative for
+     * them, and it isn't in the hashtable, so it's never shared with nodes that have the blocks.
+     * @see HashlifeWorld::faultInSubtrees
+     */
+    const bool isStub;
+    /** true if this node is a stub or has one somewhere below it */
+    const bool hasStubs;
     const block::BlockSummary blockSummary;
+    /** the block that fills this node if isUniform is true, otherwise the empty block */
+    const block::Block uniformBlock;
+    typedef std::uint64_t BlockKindPresenceMask;
+    /** has getBlockKindPresenceBit set for the kind of every block in this node */
+    const BlockKindPresenceMask blockKindPresenceMask;
+    /** hash of the level and blocks in this node that only depends on the lighting and the block
+     * kind names, so it is the same in different processes and can be stored in files
+     */
+    const std::uint64_t contentHash;
+    static constexpr std::uint64_t contentHashInitialValue = 0xCBF29CE484222325ULL;
+    /** the 64-bit finalizer from MurmurHash3: every input bit changes each output bit with
+     * probability close to 1/2
+     */
+    static std::uint64_t mixContentHash(std::uint64_t value) noexcept
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDULL;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ULL;
+        return value ^ (value >> 33);
+    }
+    static std::uint64_t combineContentHash(std::uint64_t hash, std::uint64_t value) noexcept
+    {
+        return mixContentHash(hash ^ mixContentHash(value));
+    }
+    static std::uint64_t combineContentHash(std::uint64_t hash, block::Block block) noexcept
+    {
+        constexpr block::Block::ValueType lightingMask =
+            (1UL << lighting::Lighting::lightBitWidth * 3) - 1;
+        hash = combineContentHash(hash, block.value & lightingMask);
+        return combineContentHash(hash,
+                                  block::BlockDescriptor::getNameHash(block.getBlockKind()));
+    }
+    /** block kinds share bits once there are more than 64 of them, so a set bit only means that
+     * blockKind might be present.
+     */
+    static constexpr BlockKindPresenceMask getBlockKindPresenceBit(
+        block::BlockKind blockKind) noexcept
+    {
+        return static_cast<BlockKindPresenceMask>(1)
+               << (blockKind.value % (8 * sizeof(BlockKindPresenceMask)));
+    }
     static constexpr bool isLeaf(LevelType level)
     {
         return level == 0;
@@ -370,6 +469,11 @@ public:
         return const_cast<HashlifeNodeBase *>(
             static_cast<const HashlifeNodeBase *>(this)->get(position, returnedLevel));
     }
+    /** add the number of blocks of each kind in this node to blockKindCounts.
+     * the counts for large nodes are memoized on the node, so calling this repeatedly is fast.
+     * can be called from any thread.
+     */
+    void addBlockKindCounts(HashlifeBlockKindCounts &blockKindCounts) const;
     HashlifeNodeReference<HashlifeNodeBase, false> duplicate() const &;
     HashlifeNodeReference<HashlifeNodeBase, false> duplicate() && ;
     template <bool IsAtomic>
@@ -405,10 +509,34 @@ public:
         return *getAsNonleaf(&node);
     }
     static void free(HashlifeNodeBase *node) noexcept;
+    /** make a stub for a subtree of level that isn't in memory.
+     * @param emptyChildNode the canonical empty node of level - 1, used for the stub's children
+     * @see isStub
+     */
+    static HashlifeNodeReference<const HashlifeNodeBase, false> makeStub(
+        LevelType level,
+        const block::BlockSummary &blockSummary,
+        BlockKindPresenceMask blockKindPresenceMask,
+        std::uint64_t contentHash,
+        const HashlifeNodeReference<const HashlifeNodeBase, false> &emptyChildNode);
 
 private:
-    HashlifeNodeBase(LevelType level, const block::BlockSummary &blockSummary)
-        : level((constexprAssert(level <= maxLevel), level))
+    HashlifeNodeBase(LevelType level,
+                     const block::BlockSummary &blockSummary,
+                     bool isUniform,
+                     block::Block uniformBlock,
+                     BlockKindPresenceMask blockKindPresenceMask,
+                     std::uint64_t contentHash,
+                     bool isStub,
+                     bool hasStubs)
+        : level((constexprAssert(level <= maxLevel), level)),
+          isUniform((constexprAssert(!isStub || !isUniform), isUniform)),
+          isStub(isStub),
+          hasStubs((constexprAssert(hasStubs || !isStub), hasStubs)),
+          blockSummary(blockSummary),
+          uniformBlock(isUniform ? uniformBlock : block::Block()),
+          blockKindPresenceMask(blockKindPresenceMask),
+          contentHash(contentHash)
     {
     }
 };
@@ -470,7 +598,33 @@ public:
         typedef util::Array<util::Array<util::Array<block::BlockStepExtraActions, levelSize>,
                                         levelSize>,
                             levelSize> ActionsArray;
-        ActionsArray actions;
+        /** null if all the actions are empty.
+         * @note
+         * stored out of line because almost every node has no actions and the inline array is
+         * most of the size of a nonleaf node
+         */
+        std::unique_ptr<ActionsArray> actions;
+        static std::unique_ptr<ActionsArray> compactActions(ActionsArray actions)
+        {
+            for(auto &i : actions)
+                for(auto &j : i)
+                    for(auto &v : j)
+                        if(!v.empty())
+                            return std::unique_ptr<ActionsArray>(
+                                new ActionsArray(std::move(actions)));
+            return nullptr;
+        }
+        const block::BlockStepExtraActions &getActions(util::Vector3U32 index) const noexcept
+        {
+            static const block::BlockStepExtraActions emptyActions;
+            if(!actions)
+                return emptyActions;
+            return (*actions)[index.x][index.y][index.z];
+        }
+        const block::BlockStepExtraActions &getActions(util::Vector3I32 index) const noexcept
+        {
+            return getActions(util::Vector3U32(index));
+        }
         constexpr FutureState() : node(nullptr), globalState(), actions()
         {
         }
@@ -479,13 +633,25 @@ public:
                     ActionsArray actions)
             : node(std::move(node)),
               globalState(std::move(globalState)),
-              actions(std::move(actions))
+              actions(compactActions(std::move(actions)))
         {
         }
         explicit FutureState(block::BlockStepGlobalState globalState)
             : node(nullptr), globalState(std::move(globalState)), actions()
         {
         }
+        FutureState(FutureState &&) = default;
+        FutureState &operator=(FutureState &&) = default;
+        FutureState(const FutureState &rt)
+            : node(rt.node),
+              globalState(rt.globalState),
+              actions(rt.actions ? new ActionsArray(*rt.actions) : nullptr)
+        {
+        }
+        FutureState &operator=(const FutureState &rt)
+        {
+            return operator=(FutureState(rt));
+        }
     };
     typedef util::
         Array<util::Array<util::Array<HashlifeNodeReference<const HashlifeNodeBase, false>,
@@ -500,7 +666,9 @@ public:
     const HashlifeNodeReference<const HashlifeNodeBase, false> &getChildNode(
         util::Vector3U32 index) const
     {
-        return (constexprAssert(!isLeaf()), childNodes[index.x][index.y][index.z]);
+        return (constexprAssert(!isLeaf()),
+                constexprAssert(!isStub),
+                childNodes[index.x][index.y][index.z]);
     }
     const HashlifeNodeReference<const HashlifeNodeBase, false> &getChildNode(
         util::Vector3I32 index) const
@@ -508,6 +676,25 @@ public:
         return getChildNode(util::Vector3U32(index));
     }
     mutable FutureState futureState; // ignored for operator == and hash
+
+private:
+    struct CachedBlockKindCounts final
+    {
+        std::atomic<const HashlifeBlockKindCounts *> value{nullptr};
+        CachedBlockKindCounts() = default;
+        CachedBlockKindCounts &operator=(const CachedBlockKindCounts &) = delete;
+        CachedBlockKindCounts(const CachedBlockKindCounts &) noexcept : CachedBlockKindCounts()
+        {
+        }
+        ~CachedBlockKindCounts()
+        {
+            delete value.load(std::memory_order_relaxed);
+        }
+    };
+
+public:
+    /** filled in by addBlockKindCounts; ignored for operator == and hash */
+    mutable CachedBlockKindCounts cachedBlockKindCounts;
     HashlifeNonleafNode(HashlifeNodeReference<const HashlifeNodeBase, false> nxnynz,
                         HashlifeNodeReference<const HashlifeNodeBase, false> nxnypz,
                         HashlifeNodeReference<const HashlifeNodeBase, false> nxpynz,
@@ -519,7 +706,28 @@ public:
         : HashlifeNodeBase((constexprAssert(nxnynz), nxnynz->level + 1),
                            nxnynz->blockSummary + nxnypz->blockSummary + nxpynz->blockSummary
                                + nxpypz->blockSummary + pxnynz->blockSummary + pxnypz->blockSummary
-                               + pxpynz->blockSummary + pxpypz->blockSummary),
+                               + pxpynz->blockSummary + pxpypz->blockSummary,
+                           nxnynz->isUniform && nxnypz == nxnynz && nxpynz == nxnynz
+                               && nxpypz == nxnynz && pxnynz == nxnynz && pxnypz == nxnynz
+                               && pxpynz == nxnynz && pxpypz == nxnynz,
+                           nxnynz->uniformBlock,
+                           nxnynz->blockKindPresenceMask | nxnypz->blockKindPresenceMask
+                               | nxpynz->blockKindPresenceMask | nxpypz->blockKindPresenceMask
+                               | pxnynz->blockKindPresenceMask | pxnypz->blockKindPresenceMask
+                               | pxpynz->blockKindPresenceMask | pxpypz->blockKindPresenceMask,
+                           makeContentHash(nxnynz->level + 1,
+                                           {nxnynz->contentHash,
+                                            nxnypz->contentHash,
+                                            nxpynz->contentHash,
+                                            nxpypz->contentHash,
+                                            pxnynz->contentHash,
+                                            pxnypz->contentHash,
+                                            pxpynz->contentHash,
+                                            pxpypz->contentHash}),
+                           false,
+                           nxnynz->hasStubs || nxnypz->hasStubs || nxpynz->hasStubs
+                               || nxpypz->hasStubs || pxnynz->hasStubs || pxnypz->hasStubs
+                               || pxpynz->hasStubs || pxpypz->hasStubs),
           childNodes{
               (constexprAssert(nxnynz && nxnynz->level + 1 == level), std::move(nxnynz)),
               (constexprAssert(nxnypz && nxnypz->level + 1 == level), std::move(nxnypz)),
@@ -530,7 +738,44 @@ public:
               (constexprAssert(pxpynz && pxpynz->level + 1 == level), std::move(pxpynz)),
               (constexprAssert(pxpypz && pxpypz->level + 1 == level), std::move(pxpypz)),
           },
-          futureState()
+          futureState(),
+          cachedBlockKindCounts()
+    {
+        static_assert(levelSize == 2, "");
+    }
+    struct StubTag final
+    {
+    };
+    /** @see HashlifeNodeBase::makeStub */
+    HashlifeNonleafNode(StubTag,
+                        LevelType level,
+                        const block::BlockSummary &blockSummary,
+                        BlockKindPresenceMask blockKindPresenceMask,
+                        std::uint64_t contentHash,
+                        const HashlifeNodeReference<const HashlifeNodeBase, false> &emptyChildNode)
+        : HashlifeNodeBase(level,
+                           blockSummary,
+                           false,
+                           block::Block(),
+                           blockKindPresenceMask,
+                           contentHash,
+                           true,
+                           true),
+          childNodes{
+              (constexprAssert(emptyChildNode && emptyChildNode->level + 1 == level
+                               && emptyChildNode->isUniform
+                               && emptyChildNode->uniformBlock == block::Block()),
+               emptyChildNode),
+              emptyChildNode,
+              emptyChildNode,
+              emptyChildNode,
+              emptyChildNode,
+              emptyChildNode,
+              emptyChildNode,
+              emptyChildNode,
+          },
+          futureState(),
+          cachedBlockKindCounts()
     {
         static_assert(levelSize == 2, "");
     }
@@ -546,6 +791,14 @@ public:
     {
         static_assert(levelSize == 2, "");
     }
+    static std::uint64_t makeContentHash(LevelType level,
+                                         std::initializer_list<std::uint64_t> childContentHashes)
+    {
+        std::uint64_t retval = combineContentHash(contentHashInitialValue, level);
+        for(auto childContentHash : childContentHashes)
+            retval = combineContentHash(retval, childContentHash);
+        return retval;
+    }
     static std::size_t hashNode(const ChildNodesArray &childNodes)
     {
         util::Hasher hasher;
@@ -588,7 +841,24 @@ public:
                      block::Block pxpynz,
                      block::Block pxpypz,
                      const block::BlockSummary &blockSummary)
-        : HashlifeNodeBase(0, blockSummary),
+        : HashlifeNodeBase(0,
+                           blockSummary,
+                           nxnypz == nxnynz && nxpynz == nxnynz && nxpypz == nxnynz
+                               && pxnynz == nxnynz && pxnypz == nxnynz && pxpynz == nxnynz
+                               && pxpypz == nxnynz,
+                           nxnynz,
+                           getBlockKindPresenceBit(nxnynz.getBlockKind())
+                               | getBlockKindPresenceBit(nxnypz.getBlockKind())
+                               | getBlockKindPresenceBit(nxpynz.getBlockKind())
+                               | getBlockKindPresenceBit(nxpypz.getBlockKind())
+                               | getBlockKindPresenceBit(pxnynz.getBlockKind())
+                               | getBlockKindPresenceBit(pxnypz.getBlockKind())
+                               | getBlockKindPresenceBit(pxpynz.getBlockKind())
+                               | getBlockKindPresenceBit(pxpypz.getBlockKind()),
+                           makeContentHash(
+                               {nxnynz, nxnypz, nxpynz, nxpypz, pxnynz, pxnypz, pxpynz, pxpypz}),
+                           false,
+                           false),
           blocks{
               nxnynz, nxnypz, nxpynz, nxpypz, pxnynz, pxnypz, pxpynz, pxpypz,
           }
@@ -622,7 +892,15 @@ public:
     {
     }
     HashlifeLeafNode(const BlocksArray &blocks, const block::BlockSummary &blockSummary)
-        : HashlifeNodeBase(0, blockSummary), blocks(blocks)
+        : HashlifeLeafNode(blocks[0][0][0],
+                           blocks[0][0][1],
+                           blocks[0][1][0],
+                           blocks[0][1][1],
+                           blocks[1][0][0],
+                           blocks[1][0][1],
+                           blocks[1][1][0],
+                           blocks[1][1][1],
+                           blockSummary)
     {
     }
     HashlifeLeafNode(const BlocksArray &blocks)
@@ -636,6 +914,13 @@ public:
                            blocks[1][1][1])
     {
     }
+    static std::uint64_t makeContentHash(std::initializer_list<block::Block> blocks)
+    {
+        std::uint64_t retval = combineContentHash(contentHashInitialValue, 0);
+        for(auto block : blocks)
+            retval = combineContentHash(retval, block);
+        return retval;
+    }
     static std::size_t hashNode(const BlocksArray &blocks)
     {
         util::Hasher hasher;
@@ -708,6 +993,22 @@ inline HashlifeNodeReference<HashlifeNodeBase, false> HashlifeNodeBase::duplicat
             new HashlifeNonleafNode(std::move(*getAsNonleaf(this))));
 }
 
+inline HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeNodeBase::makeStub(
+    LevelType level,
+    const block::BlockSummary &blockSummary,
+    BlockKindPresenceMask blockKindPresenceMask,
+    std::uint64_t contentHash,
+    const HashlifeNodeReference<const HashlifeNodeBase, false> &emptyChildNode)
+{
+    return HashlifeNodeReference<const HashlifeNodeBase, false>(
+        new HashlifeNonleafNode(HashlifeNonleafNode::StubTag(),
+                                level,
+                                blockSummary,
+                                blockKindPresenceMask,
+                                contentHash,
+                                emptyChildNode));
+}
+
 inline void HashlifeNodeBase::free(HashlifeNodeBase *node) noexcept
 {
     if(node->isLeaf())
@@ -29,6 +29,8 @@
 #include <unordered_map>
 #include <deque>
 #include <memory>
+#include <algorithm>
+#include <limits>
 
 namespace programmerjake
 {
@@ -40,11 +42,18 @@ HashlifeWorld::HashlifeWorld(PrivateAccessTag)
     : garbageCollectedHashtable(),
       renderCacheEntryReferences(),
       rootNode(garbageCollectedHashtable.getCanonicalEmptyNode(1)),
+      stubSources(),
       renderCache(),
-      renderCacheEntryList()
+      renderCacheEntryList(),
+      transformedNodes(),
+      stillNodes(),
+      periodicNodes()
 {
 }
 
+constexpr HashlifeNodeBase::LevelType HashlifeWorld::stillNodeMinimumLevel;
+constexpr HashlifeNodeBase::LevelType HashlifeWorld::isolatedNodeMinimumLevel;
+
 void HashlifeWorld::collectGarbage(std::size_t garbageCollectTargetNodeCount,
                                    std::size_t renderCacheTargetEntryCount)
 {
@@ -53,14 +62,28 @@ void HashlifeWorld::collectGarbage(std::size_t garbageCollectTargetNodeCount,
         renderCache.erase(*renderCacheEntryList.back());
         renderCacheEntryList.pop_back();
     }
+    if(garbageCollectedHashtable.needGarbageCollect(garbageCollectTargetNodeCount))
+    {
+        transformedNodes.clear();
+        stillNodes.clear();
+        periodicNodes.clear();
+    }
     garbageCollectedHashtable.garbageCollect(garbageCollectTargetNodeCount);
+    for(auto iter = stubSources.begin(); iter != stubSources.end();)
+    {
+        if(std::get<1>(*iter).stub.unique())
+            iter = stubSources.erase(iter);
+        else
+            ++iter;
+    }
 }
 
-void HashlifeWorld::expandRoot()
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::getExpandedNode(
+    const HashlifeNodeBase *node)
 {
-    constexprAssert(!rootNode->isLeaf());
-    auto emptyNode = garbageCollectedHashtable.getCanonicalEmptyNode(rootNode->level - 1);
-    HashlifeNonleafNode::ChildNodesArray newRootNode;
+    constexprAssert(!node->isLeaf());
+    auto emptyNode = garbageCollectedHashtable.getCanonicalEmptyNode(node->level - 1);
+    HashlifeNonleafNode::ChildNodesArray newNode;
     for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
     {
         for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
@@ -77,13 +100,255 @@ void HashlifeWorld::expandRoot()
                                                                   emptyNode};
                 static_assert(HashlifeNodeBase::levelSize == 2, "");
                 newChildNode[2 - position.x - 1][2 - position.y - 1][2 - position.z - 1] =
-                    getAsNonleaf(rootNode.get())->getChildNode(position);
-                newRootNode[position.x][position.y][position.z] =
+                    getAsNonleaf(node)->getChildNode(position);
+                newNode[position.x][position.y][position.z] =
                     garbageCollectedHashtable.findOrAddNode(std::move(newChildNode));
             }
         }
     }
-    rootNode = garbageCollectedHashtable.findOrAddNode(std::move(newRootNode));
+    return garbageCollectedHashtable.findOrAddNode(std::move(newNode));
+}
+
+void HashlifeWorld::expandRoot()
+{
+    rootNode = getExpandedNode(rootNode.get());
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::cropNode(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 nodeMinPosition,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 endPosition)
+{
+    auto nodeEndPosition = nodeMinPosition + util::Vector3I32(node->getSize());
+    if((max(minPosition, nodeMinPosition) - min(endPosition, nodeEndPosition)).max() >= 0)
+        return garbageCollectedHashtable.getCanonicalEmptyNode(node->level);
+    if((minPosition - nodeMinPosition).max() <= 0 && (nodeEndPosition - endPosition).max() <= 0)
+        return node->referenceFromThis<false>();
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto childSize = node->getHalfSize();
+    if(node->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+        {
+            for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+            {
+                for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+                {
+                    auto position = nodeMinPosition + index;
+                    bool isInside = (minPosition - position).max() <= 0
+                                    && (position - endPosition).max() < 0;
+                    blocks[index.x][index.y][index.z] =
+                        isInside ? getAsLeaf(node)->getBlock(index) : block::Block();
+                }
+            }
+        }
+        return garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                childNodes[index.x][index.y][index.z] =
+                    cropNode(getAsNonleaf(node)->getChildNode(index).get(),
+                             nodeMinPosition + index * util::Vector3I32(childSize),
+                             minPosition,
+                             endPosition);
+            }
+        }
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::predictRegion(
+    const Snapshot &snapshot,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 maxPosition,
+    const std::vector<block::BlockStepGlobalState> &stepGlobalStates)
+{
+    // blocks can only affect their neighbors each generation, so only the blocks within this
+    // distance of the region can affect it
+    std::int64_t lightConeRadius = static_cast<std::int64_t>(stepGlobalStates.size())
+                                   * block::BlockStepGlobalState::stepSizeInGenerations;
+    auto rootNode = snapshot.rootNode.get();
+    auto rootMinPosition = util::Vector3I32(-rootNode->getHalfSize());
+    auto rootEndPosition = util::Vector3I32(rootNode->getHalfSize());
+    auto clipToRoot = [&](util::Vector3<std::int64_t> position)
+    {
+        return util::Vector3I32(max(util::Vector3<std::int64_t>(rootMinPosition),
+                                    min(util::Vector3<std::int64_t>(rootEndPosition), position)));
+    };
+    auto croppedMinPosition = clipToRoot(util::Vector3<std::int64_t>(minPosition)
+                                         - util::Vector3<std::int64_t>(lightConeRadius));
+    auto croppedEndPosition = clipToRoot(util::Vector3<std::int64_t>(maxPosition)
+                                         + util::Vector3<std::int64_t>(lightConeRadius + 1));
+    std::size_t faultedInCount = 0;
+    HashlifeNodeReference<const HashlifeNodeBase, false> node =
+        faultInNode(rootNode,
+                    rootMinPosition,
+                    util::Vector3<std::int64_t>(croppedMinPosition),
+                    util::Vector3<std::int64_t>(croppedEndPosition),
+                    faultedInCount);
+    node = cropNode(node.get(), rootMinPosition, croppedMinPosition, croppedEndPosition);
+    for(auto &stepGlobalState : stepGlobalStates)
+    {
+        // same as step, but on the cropped tree
+        do
+        {
+            node = getExpandedNode(node.get());
+        } while(HashlifeNonleafNode::FutureState::getStepSizeInGenerations(node->level)
+                < block::BlockStepGlobalState::stepSizeInGenerations);
+        node = getFilledFutureState(node.get(), stepGlobalState).node;
+    }
+    return std::make_shared<Snapshot>(HashlifeNodeReference<const HashlifeNodeBase, true>(node),
+                                      PrivateAccessTag());
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::getCenterNode(
+    const HashlifeNodeBase *node)
+{
+    constexprAssert(!node->isLeaf());
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    if(node->level == 1)
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+        {
+            for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+            {
+                for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+                {
+                    auto &childNode = getAsNonleaf(node)->getChildNode(index);
+                    blocks[index.x][index.y][index.z] =
+                        getAsLeaf(childNode.get())->getBlock(util::Vector3I32(1) - index);
+                }
+            }
+        }
+        return garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                auto &childNode = getAsNonleaf(node)->getChildNode(index);
+                childNodes[index.x][index.y][index.z] =
+                    getAsNonleaf(childNode.get())->getChildNode(util::Vector3I32(1) - index);
+            }
+        }
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+namespace
+{
+/** check if futureNode is the center of node without making the center node */
+bool isCenterNode(const HashlifeNonleafNode *node, const HashlifeNodeBase *futureNode) noexcept
+{
+    constexprAssert(futureNode->level == node->level - 1);
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                auto &childNode = node->getChildNode(index);
+                if(futureNode->isLeaf())
+                {
+                    if(getAsLeaf(futureNode)->getBlock(index)
+                       != getAsLeaf(childNode.get())->getBlock(util::Vector3I32(1) - index))
+                        return false;
+                }
+                else if(getAsNonleaf(futureNode)->getChildNode(index)
+                        != getAsNonleaf(childNode.get())->getChildNode(util::Vector3I32(1)
+                                                                         - index))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::stepIsolatedNode(
+    const HashlifeNodeBase *node, const block::BlockStepGlobalState &stepGlobalState)
+{
+    constexprAssert(node->level >= isolatedNodeMinimumLevel);
+    auto expandedNode = getExpandedNode(getExpandedNode(node).get());
+    auto &futureState = getFilledFutureState(expandedNode.get(), stepGlobalState);
+    auto retval = getCenterNode(futureState.node.get());
+    if(getExpandedNode(retval.get()) != futureState.node)
+        return nullptr;
+    return retval;
+}
+
+util::Optional<std::uint32_t> HashlifeWorld::findPeriod(
+    const Snapshot &snapshot,
+    std::uint32_t maxPeriod,
+    const block::BlockStepGlobalState &stepGlobalState)
+{
+    auto startNode = faultInAll(snapshot.rootNode.get());
+    while(startNode->level < isolatedNodeMinimumLevel)
+        startNode = getExpandedNode(startNode.get());
+    auto iter = periodicNodes.find(NodeGlobalStateKey{startNode, stepGlobalState});
+    if(iter != periodicNodes.end())
+    {
+        if(iter->second > maxPeriod)
+            return util::nullOpt;
+        return iter->second;
+    }
+    std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> cycleNodes;
+    cycleNodes.push_back(startNode);
+    for(std::uint32_t period = 1; period <= maxPeriod; period++)
+    {
+        auto node = stepIsolatedNode(cycleNodes.back().get(), stepGlobalState);
+        if(!node)
+            return util::nullOpt;
+        if(node == startNode)
+        {
+            for(auto &cycleNode : cycleNodes)
+                periodicNodes[NodeGlobalStateKey{std::move(cycleNode), stepGlobalState}] = period;
+            return period;
+        }
+        cycleNodes.push_back(std::move(node));
+    }
+    return util::nullOpt;
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::fastForward(
+    const Snapshot &snapshot,
+    std::uint64_t stepCount,
+    const block::BlockStepGlobalState &stepGlobalState,
+    std::uint32_t maxPeriod)
+{
+    auto node = faultInAll(snapshot.rootNode.get());
+    auto period = findPeriod(
+        Snapshot(HashlifeNodeReference<const HashlifeNodeBase, true>(node), PrivateAccessTag()),
+        maxPeriod,
+        stepGlobalState);
+    if(period)
+        stepCount %= *period;
+    for(std::uint64_t i = 0; i < stepCount; i++)
+    {
+        // same as step
+        do
+        {
+            node = getExpandedNode(node.get());
+        } while(HashlifeNonleafNode::FutureState::getStepSizeInGenerations(node->level)
+                < block::BlockStepGlobalState::stepSizeInGenerations);
+        node = getFilledFutureState(node.get(), stepGlobalState).node;
+    }
+    return std::make_shared<Snapshot>(HashlifeNodeReference<const HashlifeNodeBase, true>(node),
+                                      PrivateAccessTag());
 }
 
 const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
@@ -96,7 +361,16 @@ const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
         constexprAssert(node->futureState.node->level == node->level - 1);
         return node->futureState;
     }
+    if(node->level >= stillNodeMinimumLevel && !stillNodes.empty()
+       && stillNodes.count(NodeGlobalStateKey{node->referenceFromThis<false>(), stepGlobalState}))
+    {
+        HashlifeNonleafNode::FutureState futureState(stepGlobalState);
+        futureState.node = getCenterNode(node);
+        node->futureState = std::move(futureState);
+        return node->futureState;
+    }
     HashlifeNonleafNode::FutureState futureState(stepGlobalState);
+    HashlifeNonleafNode::FutureState::ActionsArray actions;
     if(node->level == 1)
     {
         HashlifeLeafNode::BlocksArray futureNode;
@@ -127,7 +401,7 @@ const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
                     auto stepResult = block::BlockDescriptor::step(blockStepInput, stepGlobalState);
 #endif
                     futureNode[x][y][z] = stepResult.block;
-                    futureState.actions[x][y][z] +=
+                    actions[x][y][z] +=
                         block::BlockStepExtraActions(std::forward<decltype(stepResult)>(stepResult)
                                                   .extraActions).addOffset(blockStepInputCenter);
                 }
@@ -202,10 +476,8 @@ const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
                                                               * HashlifeNodeBase::levelSize)
                                     continue;
                                 outputPosition /= util::Vector3I32(HashlifeNodeBase::levelSize);
-                                futureState.actions[outputPosition.x][outputPosition
-                                                                          .y][outputPosition.z] +=
-                                    block::BlockStepExtraActions(
-                                        result.actions[position.x][position.y][position.z])
+                                actions[outputPosition.x][outputPosition.y][outputPosition.z] +=
+                                    block::BlockStepExtraActions(result.getActions(position))
                                         .addOffset(offsetInEighths
                                                    * util::Vector3I32(node->getEighthSize()));
                             }
@@ -340,9 +612,8 @@ const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
                                     auto offsetInEighths =
                                         chunkPos * util::Vector3I32(HashlifeNodeBase::levelSize)
                                         - util::Vector3I32(1);
-                                    futureState.actions[chunkPos.x][chunkPos.y][chunkPos.z] +=
-                                        block::BlockStepExtraActions(
-                                            result.actions[position.x][position.y][position.z])
+                                    actions[chunkPos.x][chunkPos.y][chunkPos.z] +=
+                                        block::BlockStepExtraActions(result.getActions(position))
                                             .addOffset(offsetInEighths
                                                        * util::Vector3I32(node->getEighthSize()));
                                 }
@@ -356,10 +627,1545 @@ const HashlifeNonleafNode::FutureState &HashlifeWorld::getFilledFutureState(
         futureState.node = garbageCollectedHashtable.findOrAddNode(std::move(output));
     }
     constexprAssert(futureState.node->level == node->level - 1);
+    futureState.actions = HashlifeNonleafNode::FutureState::compactActions(std::move(actions));
+    if(node->level >= stillNodeMinimumLevel && !futureState.actions
+       && isCenterNode(node, futureState.node.get()))
+        stillNodes.insert(NodeGlobalStateKey{node->referenceFromThis<false>(), stepGlobalState});
     node->futureState = std::move(futureState);
     return node->futureState;
 }
 
+void HashlifeWorld::getBlocksImplementation(const HashlifeNodeBase *node,
+                                            ContiguousBlocksArray blocksArray,
+                                            util::Vector3I32 worldPosition,
+                                            util::Vector3I32 arrayPosition,
+                                            util::Vector3I32 size)
+{
+    constexprAssert(size.min() >= 0);
+    constexprAssert((arrayPosition + size - blocksArray.arraySize).max() <= 0);
+    if(size.min() == 0)
+        return;
+    constexprAssert(node->isPositionInside(worldPosition));
+    constexprAssert(node->isPositionInside(worldPosition + size - util::Vector3I32(1)));
+    if(node->isUniform)
+    {
+        for(std::int32_t x = arrayPosition.x; x < arrayPosition.x + size.x; x++)
+        {
+            for(std::int32_t y = arrayPosition.y; y < arrayPosition.y + size.y; y++)
+            {
+                std::fill_n(blocksArray.getRow(x, y) + arrayPosition.z, size.z, node->uniformBlock);
+            }
+        }
+        return;
+    }
+    if(node->isLeaf())
+    {
+        static_assert(HashlifeNodeBase::levelSize % 2 == 0, "");
+        auto offset = util::Vector3I32(HashlifeNodeBase::levelSize / 2) + worldPosition;
+        for(std::int32_t x = 0; x < size.x; x++)
+        {
+            for(std::int32_t y = 0; y < size.y; y++)
+            {
+                auto row = blocksArray.getRow(x + arrayPosition.x, y + arrayPosition.y)
+                           + arrayPosition.z;
+                for(std::int32_t z = 0; z < size.z; z++)
+                    row[z] = getAsLeaf(node)->getBlock(
+                        util::Vector3I32(x + offset.x, y + offset.y, z + offset.z));
+            }
+        }
+        return;
+    }
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                static_assert(HashlifeNodeBase::levelSize % 2 == 0, "");
+                auto minInputPosition =
+                    (position - util::Vector3I32(HashlifeNodeBase::levelSize / 2))
+                    * util::Vector3I32(node->getHalfSize());
+                auto offset = -util::Vector3I32(node->getQuarterSize()) - minInputPosition;
+                auto endInputPosition = minInputPosition + util::Vector3I32(node->getHalfSize());
+                minInputPosition = max(minInputPosition, worldPosition);
+                endInputPosition = min(endInputPosition, worldPosition + size);
+                if((endInputPosition - minInputPosition).min() > 0)
+                    getBlocksImplementation(getAsNonleaf(node)->getChildNode(position).get(),
+                                            blocksArray,
+                                            minInputPosition + offset,
+                                            arrayPosition - worldPosition + minInputPosition,
+                                            endInputPosition - minInputPosition);
+            }
+        }
+    }
+}
+
+struct HashlifeWorld::RayCastState final
+{
+    double startPosition[3];
+    double direction[3];
+    double inverseDirection[3];
+    double maxT;
+    explicit RayCastState(const util::ray_casting::Ray &ray, float maxT)
+        : startPosition{ray.startPosition.x, ray.startPosition.y, ray.startPosition.z},
+          direction{ray.direction.x, ray.direction.y, ray.direction.z},
+          inverseDirection{},
+          maxT(maxT)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(direction[axis] != 0)
+                inverseDirection[axis] = 1 / direction[axis];
+            startPosition[axis] = getIteratorStartPosition(startPosition[axis], direction[axis]);
+        }
+    }
+    RayCastState(const RayPacketState &packetState, std::size_t lane);
+    /** RayBlockIterator starts in the block at floor(startPosition) even when the ray starts on a
+     * block boundary and moves in the negative direction, so it stays in that block for a whole
+     * block width; move the start position so the ray visits the same blocks.
+     */
+    static double getIteratorStartPosition(double startPosition, double direction) noexcept
+    {
+        if(direction < 0 && startPosition == std::floor(startPosition))
+            return startPosition + 1;
+        return startPosition;
+    }
+    /** RayBlockIterator crosses the block boundaries that the ray reaches at the same t in z, y,
+     * x order, so crossings at the same t are ordered by this to visit the same blocks when the
+     * ray passes exactly through an edge or corner.
+     * @param axis the axis of the crossed boundary, or -1 for starting in a box or reaching maxT,
+     * which come after any crossing at the same t
+     */
+    static constexpr int getCrossingOrder(int axis) noexcept
+    {
+        return 2 - axis;
+    }
+    /** get where the ray enters the box
+     * @param enterAxis set to the axis of the face the ray enters through, or -1 if the ray
+     * starts inside the box
+     * @return true if the ray passes through the box
+     */
+    bool getBoxInterval(util::Vector3I32 minPosition,
+                        double size,
+                        double &enterT,
+                        int &enterAxis) const noexcept
+    {
+        enterT = 0;
+        enterAxis = -1;
+        double exitT = maxT;
+        const std::int32_t minPositionArray[3] = {minPosition.x, minPosition.y, minPosition.z};
+        for(int axis = 0; axis < 3; axis++)
+        {
+            double minValue = minPositionArray[axis];
+            double endValue = minValue + size;
+            if(direction[axis] == 0)
+            {
+                if(startPosition[axis] < minValue || startPosition[axis] >= endValue)
+                    return false;
+                continue;
+            }
+            double t0 = (minValue - startPosition[axis]) * inverseDirection[axis];
+            double t1 = (endValue - startPosition[axis]) * inverseDirection[axis];
+            if(t0 > t1)
+                std::swap(t0, t1);
+            // going from x to z keeps the axis crossed last when the ray crosses several at once
+            if(t0 > enterT)
+            {
+                enterT = t0;
+                enterAxis = axis;
+            }
+            if(t1 < exitT)
+                exitT = t1;
+        }
+        if(enterT != exitT)
+            return enterT < exitT;
+        // the ray only touches an edge or corner of the box
+        int exitAxis = getExitAxis(minPosition, size, exitT);
+        return getCrossingOrder(enterAxis) < getCrossingOrder(exitAxis);
+    }
+    /** @return the first crossed axis where the ray leaves the box at exitT, or -1 if it reaches
+     * maxT first
+     */
+    int getExitAxis(util::Vector3I32 minPosition, double size, double exitT) const noexcept
+    {
+        const std::int32_t minPositionArray[3] = {minPosition.x, minPosition.y, minPosition.z};
+        for(int axis = 2; axis >= 0; axis--)
+        {
+            if(direction[axis] == 0)
+                continue;
+            double endValue = direction[axis] < 0 ? minPositionArray[axis] :
+                                                    minPositionArray[axis] + size;
+            if((endValue - startPosition[axis]) * inverseDirection[axis] == exitT)
+                return axis;
+        }
+        return -1;
+    }
+};
+
+bool HashlifeWorld::castRay(const HashlifeNodeBase *node,
+                            util::Vector3I32 nodeMinPosition,
+                            const RayCastState &state,
+                            RayCastHit &hit)
+{
+    if(node->blockSummary.areAllBlocksRenderedLikeAir)
+        return false;
+    struct Child final
+    {
+        double enterT;
+        int enterAxis;
+        util::Vector3I32 index;
+        util::Vector3I32 minPosition;
+    };
+    auto isEnteredAfter = [](const Child &a, const Child &b) -> bool
+    {
+        return a.enterT > b.enterT
+               || (a.enterT == b.enterT
+                   && RayCastState::getCrossingOrder(a.enterAxis)
+                          > RayCastState::getCrossingOrder(b.enterAxis));
+    };
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    Child children[HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize
+                   * HashlifeNodeBase::levelSize];
+    std::size_t childCount = 0;
+    auto childSize = node->getHalfSize();
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                Child child;
+                child.index = index;
+                child.minPosition = nodeMinPosition + index * util::Vector3I32(childSize);
+                if(!state.getBoxInterval(
+                       child.minPosition, childSize, child.enterT, child.enterAxis))
+                    continue;
+                // insertion sort by where the ray enters; the ray visits at most 4 children
+                std::size_t insertIndex = childCount++;
+                for(; insertIndex > 0 && isEnteredAfter(children[insertIndex - 1], child);
+                    insertIndex--)
+                    children[insertIndex] = children[insertIndex - 1];
+                children[insertIndex] = child;
+            }
+        }
+    }
+    for(std::size_t i = 0; i < childCount; i++)
+    {
+        auto &child = children[i];
+        if(node->isLeaf())
+        {
+            auto block = getAsLeaf(node)->getBlock(child.index);
+            if(block::BlockDescriptor::getBlockSummary(block.getBlockKind())
+                   .areAllBlocksRenderedLikeAir)
+                continue;
+            hit.t = std::max<float>(child.enterT, util::ray_casting::Ray::eps);
+            hit.blockPosition = child.minPosition;
+            hit.block = block;
+            hit.blockFace = util::nullOpt;
+            if(child.enterAxis >= 0)
+            {
+                static constexpr block::BlockFace negativeFaces[3] = {
+                    block::BlockFace::NX, block::BlockFace::NY, block::BlockFace::NZ,
+                };
+                auto face = negativeFaces[child.enterAxis];
+                // entering through the negative side means moving in the positive direction
+                hit.blockFace =
+                    state.direction[child.enterAxis] > 0 ? face : block::reverse(face);
+            }
+            return true;
+        }
+        if(castRay(getAsNonleaf(node)->getChildNode(child.index).get(),
+                   child.minPosition,
+                   state,
+                   hit))
+            return true;
+    }
+    return false;
+}
+
+util::Optional<HashlifeWorld::RayCastHit> HashlifeWorld::castRayImplementation(
+    const HashlifeNodeBase *rootNode, const util::ray_casting::Ray &ray, float maxT)
+{
+    RayCastState state(ray, maxT);
+    auto rootMinPosition = util::Vector3I32(-rootNode->getHalfSize());
+    double enterT;
+    int enterAxis;
+    if(!state.getBoxInterval(rootMinPosition, rootNode->getSize(), enterT, enterAxis))
+        return util::nullOpt;
+    RayCastHit hit;
+    if(castRay(rootNode, rootMinPosition, state, hit))
+        return hit;
+    return util::nullOpt;
+}
+
+/** the rays in a packet all have the same direction signs, so they all visit the children of a
+ * node in the same order. The per-ray math is laid out as structure of arrays so the compiler can
+ * vectorize it.
+ */
+struct HashlifeWorld::RayPacketState final
+{
+    static constexpr std::size_t packetSize = 8;
+    static_assert(packetSize <= 32, "masks are 32 bits");
+    double startPosition[3][packetSize];
+    double direction[3][packetSize];
+    double inverseDirection[3][packetSize];
+    double maxT;
+    /** xor'ed with the linear child index to get front to back order */
+    std::uint32_t childIndexXorMask;
+    std::uint32_t hitMask;
+    RayCastHit hits[packetSize];
+    /** @param rays the rays in this packet; if there are less than packetSize rays, the last ray
+     * is repeated
+     */
+    RayPacketState(const util::ray_casting::Ray *const *rays,
+                   std::size_t rayCount,
+                   float maxT,
+                   std::uint32_t childIndexXorMask)
+        : maxT(maxT), childIndexXorMask(childIndexXorMask), hitMask(0)
+    {
+        // stands in for 1 / 0 so rays parallel to an axis don't need a separate code path
+        constexpr double hugeInverseDirection = 1e300;
+        for(std::size_t lane = 0; lane < packetSize; lane++)
+        {
+            auto &ray = *rays[std::min(lane, rayCount - 1)];
+            const float startPositionArray[3] = {
+                ray.startPosition.x, ray.startPosition.y, ray.startPosition.z,
+            };
+            const float directionArray[3] = {
+                ray.direction.x, ray.direction.y, ray.direction.z,
+            };
+            for(int axis = 0; axis < 3; axis++)
+            {
+                startPosition[axis][lane] = RayCastState::getIteratorStartPosition(
+                    startPositionArray[axis], directionArray[axis]);
+                direction[axis][lane] = directionArray[axis];
+                inverseDirection[axis][lane] =
+                    directionArray[axis] != 0 ? 1 / directionArray[axis] : hugeInverseDirection;
+            }
+        }
+    }
+    /** get where each ray enters the box, like RayCastState::getBoxInterval
+     * @return the mask of the rays that pass through the box
+     */
+    std::uint32_t getBoxIntervals(util::Vector3I32 minPosition,
+                                  double size,
+                                  double (&enterT)[packetSize],
+                                  int (&enterAxis)[packetSize]) const noexcept
+    {
+        double exitT[packetSize];
+        for(std::size_t lane = 0; lane < packetSize; lane++)
+        {
+            enterT[lane] = 0;
+            exitT[lane] = maxT;
+            enterAxis[lane] = -1;
+        }
+        const std::int32_t minPositionArray[3] = {minPosition.x, minPosition.y, minPosition.z};
+        for(int axis = 0; axis < 3; axis++)
+        {
+            double minValue = minPositionArray[axis];
+            double endValue = minValue + size;
+            for(std::size_t lane = 0; lane < packetSize; lane++)
+            {
+                double t0 = (minValue - startPosition[axis][lane]) * inverseDirection[axis][lane];
+                double t1 = (endValue - startPosition[axis][lane]) * inverseDirection[axis][lane];
+                double nearT = std::min(t0, t1);
+                double farT = std::max(t0, t1);
+                bool isEnterAxis = nearT > enterT[lane];
+                enterT[lane] = isEnterAxis ? nearT : enterT[lane];
+                enterAxis[lane] = isEnterAxis ? axis : enterAxis[lane];
+                exitT[lane] = std::min(exitT[lane], farT);
+            }
+        }
+        std::uint32_t retval = 0;
+        for(std::size_t lane = 0; lane < packetSize; lane++)
+        {
+            if(enterT[lane] == exitT[lane])
+            {
+                // the ray only touches an edge or corner of the box
+                if(RayCastState(*this, lane).getBoxInterval(
+                       minPosition, size, enterT[lane], enterAxis[lane]))
+                    retval |= static_cast<std::uint32_t>(1) << lane;
+            }
+            else if(enterT[lane] < exitT[lane])
+            {
+                retval |= static_cast<std::uint32_t>(1) << lane;
+            }
+        }
+        return retval;
+    }
+};
+
+constexpr std::size_t HashlifeWorld::RayPacketState::packetSize;
+
+HashlifeWorld::RayCastState::RayCastState(const RayPacketState &packetState, std::size_t lane)
+    : startPosition{}, direction{}, inverseDirection{}, maxT(packetState.maxT)
+{
+    for(int axis = 0; axis < 3; axis++)
+    {
+        startPosition[axis] = packetState.startPosition[axis][lane];
+        direction[axis] = packetState.direction[axis][lane];
+        if(direction[axis] != 0)
+            inverseDirection[axis] = 1 / direction[axis];
+    }
+}
+
+void HashlifeWorld::castRayPacket(const HashlifeNodeBase *node,
+                                  util::Vector3I32 nodeMinPosition,
+                                  std::uint32_t activeMask,
+                                  RayPacketState &state)
+{
+    if(node->blockSummary.areAllBlocksRenderedLikeAir)
+        return;
+    if((activeMask & (activeMask - 1)) == 0)
+    {
+        // the packet has diverged to a single ray, so trace it on its own
+        std::size_t lane = 0;
+        while(!(activeMask & (static_cast<std::uint32_t>(1) << lane)))
+            lane++;
+        RayCastState rayState(state, lane);
+        if(castRay(node, nodeMinPosition, rayState, state.hits[lane]))
+            state.hitMask |= activeMask;
+        return;
+    }
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto childSize = node->getHalfSize();
+    for(std::uint32_t i = 0; i < 8 && activeMask != 0; i++)
+    {
+        std::uint32_t linearIndex = i ^ state.childIndexXorMask;
+        util::Vector3I32 index((linearIndex >> 2) & 1, (linearIndex >> 1) & 1, linearIndex & 1);
+        block::Block block;
+        if(node->isLeaf())
+        {
+            block = getAsLeaf(node)->getBlock(index);
+            if(block::BlockDescriptor::getBlockSummary(block.getBlockKind())
+                   .areAllBlocksRenderedLikeAir)
+                continue;
+        }
+        auto minPosition = nodeMinPosition + index * util::Vector3I32(childSize);
+        double enterT[RayPacketState::packetSize];
+        int enterAxis[RayPacketState::packetSize];
+        auto childMask =
+            activeMask & state.getBoxIntervals(minPosition, childSize, enterT, enterAxis);
+        if(childMask == 0)
+            continue;
+        if(!node->isLeaf())
+        {
+            castRayPacket(
+                getAsNonleaf(node)->getChildNode(index).get(), minPosition, childMask, state);
+            activeMask &= ~state.hitMask;
+            continue;
+        }
+        for(std::size_t lane = 0; lane < RayPacketState::packetSize; lane++)
+        {
+            if(!(childMask & (static_cast<std::uint32_t>(1) << lane)))
+                continue;
+            auto &hit = state.hits[lane];
+            hit.t = std::max<float>(enterT[lane], util::ray_casting::Ray::eps);
+            hit.blockPosition = minPosition;
+            hit.block = block;
+            hit.blockFace = util::nullOpt;
+            if(enterAxis[lane] >= 0)
+            {
+                static constexpr block::BlockFace negativeFaces[3] = {
+                    block::BlockFace::NX, block::BlockFace::NY, block::BlockFace::NZ,
+                };
+                auto face = negativeFaces[enterAxis[lane]];
+                hit.blockFace = state.direction[enterAxis[lane]][lane] > 0 ? face :
+                                                                             block::reverse(face);
+            }
+        }
+        state.hitMask |= childMask;
+        activeMask &= ~childMask;
+    }
+}
+
+std::vector<util::Optional<HashlifeWorld::RayCastHit>> HashlifeWorld::castRaysImplementation(
+    const HashlifeNodeBase *rootNode, const std::vector<util::ray_casting::Ray> &rays, float maxT)
+{
+    std::vector<util::Optional<RayCastHit>> retval(rays.size());
+    // group the rays by which way they point along each axis, keeping the original order within
+    // each group so neighboring rays end up in the same packet
+    auto getChildIndexXorMask = [](const util::ray_casting::Ray &ray) -> std::uint32_t
+    {
+        return (ray.direction.x < 0 ? 4 : 0) | (ray.direction.y < 0 ? 2 : 0)
+               | (ray.direction.z < 0 ? 1 : 0);
+    };
+    // rays that diverge quickly just make the packet visit more nodes, so only trace rays that
+    // start close together and point in close to the same direction as a packet
+    auto isRayCoherent = [](const util::ray_casting::Ray &a,
+                            const util::ray_casting::Ray &b) -> bool
+    {
+        constexpr float maxStartDistance = 2;
+        constexpr float minDirectionCosine = 0.95f;
+        auto startDistance =
+            util::Vector3F(a.startPosition - b.startPosition).norm(util::maximumMetric);
+        return startDistance <= maxStartDistance
+               && dot(a.direction, b.direction)
+                      >= minDirectionCosine * std::sqrt(a.direction.normSquared()
+                                                        * b.direction.normSquared());
+    };
+    std::vector<const util::ray_casting::Ray *> sortedRays;
+    sortedRays.reserve(rays.size());
+    for(std::uint32_t childIndexXorMask = 0; childIndexXorMask < 8; childIndexXorMask++)
+        for(auto &ray : rays)
+            if(getChildIndexXorMask(ray) == childIndexXorMask)
+                sortedRays.push_back(&ray);
+    auto rootMinPosition = util::Vector3I32(-rootNode->getHalfSize());
+    for(std::size_t packetStart = 0; packetStart < sortedRays.size();)
+    {
+        auto &firstRay = *sortedRays[packetStart];
+        auto childIndexXorMask = getChildIndexXorMask(firstRay);
+        std::size_t rayCount = 1;
+        while(rayCount < RayPacketState::packetSize && packetStart + rayCount < sortedRays.size())
+        {
+            auto &ray = *sortedRays[packetStart + rayCount];
+            if(getChildIndexXorMask(ray) != childIndexXorMask
+               || !isRayCoherent(firstRay, ray))
+                break;
+            rayCount++;
+        }
+        if(rayCount == 1)
+        {
+            retval[sortedRays[packetStart] - rays.data()] =
+                castRayImplementation(rootNode, firstRay, maxT);
+            packetStart++;
+            continue;
+        }
+        RayPacketState state(&sortedRays[packetStart], rayCount, maxT, childIndexXorMask);
+        double enterT[RayPacketState::packetSize];
+        int enterAxis[RayPacketState::packetSize];
+        std::uint32_t activeMask =
+            state.getBoxIntervals(rootMinPosition, rootNode->getSize(), enterT, enterAxis)
+            & ((static_cast<std::uint32_t>(1) << rayCount) - 1);
+        if(activeMask != 0)
+            castRayPacket(rootNode, rootMinPosition, activeMask, state);
+        for(std::size_t lane = 0; lane < rayCount; lane++)
+            if(state.hitMask & (static_cast<std::uint32_t>(1) << lane))
+                retval[sortedRays[packetStart + lane] - rays.data()] = state.hits[lane];
+        packetStart += rayCount;
+    }
+    return retval;
+}
+
+namespace
+{
+/** call fn for each block in [minPosition, endPosition) that matches isBlockMatched, skipping the
+ * subtrees where canNodeMatch returns false.
+ */
+template <typename CanNodeMatch, typename IsBlockMatched, typename Fn>
+void findMatchingBlocks(const HashlifeNodeBase *node,
+                        util::Vector3I32 nodeMinPosition,
+                        util::Vector3I32 minPosition,
+                        util::Vector3I32 endPosition,
+                        CanNodeMatch &canNodeMatch,
+                        IsBlockMatched &isBlockMatched,
+                        Fn &fn)
+{
+    if(!canNodeMatch(node))
+        return;
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto childSize = node->getHalfSize();
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                auto childMinPosition = nodeMinPosition + index * util::Vector3I32(childSize);
+                auto childEndPosition = childMinPosition + util::Vector3I32(childSize);
+                if((max(minPosition, childMinPosition) - min(endPosition, childEndPosition)).max()
+                   >= 0)
+                    continue;
+                if(!node->isLeaf())
+                {
+                    findMatchingBlocks(getAsNonleaf(node)->getChildNode(index).get(),
+                                       childMinPosition,
+                                       minPosition,
+                                       endPosition,
+                                       canNodeMatch,
+                                       isBlockMatched,
+                                       fn);
+                    continue;
+                }
+                auto block = getAsLeaf(node)->getBlock(index);
+                if(isBlockMatched(block))
+                    fn(childMinPosition, block);
+            }
+        }
+    }
+}
+
+/** clip [minPosition, endPosition) to rootNode then call findMatchingBlocks */
+template <typename CanNodeMatch, typename IsBlockMatched, typename Fn>
+void findMatchingBlocksInRoot(const HashlifeNodeBase *rootNode,
+                              util::Vector3I32 minPosition,
+                              util::Vector3I32 endPosition,
+                              CanNodeMatch canNodeMatch,
+                              IsBlockMatched isBlockMatched,
+                              Fn &fn)
+{
+    auto rootMinPosition = util::Vector3I32(-rootNode->getHalfSize());
+    auto rootEndPosition = util::Vector3I32(rootNode->getHalfSize());
+    minPosition = max(minPosition, rootMinPosition);
+    endPosition = min(endPosition, rootEndPosition);
+    if((minPosition - endPosition).max() >= 0)
+        return;
+    findMatchingBlocks(
+        rootNode, rootMinPosition, minPosition, endPosition, canNodeMatch, isBlockMatched, fn);
+}
+}
+
+void HashlifeWorld::findCollidingBlocksImplementation(
+    const HashlifeNodeBase *rootNode,
+    util::Vector3F boxMinPosition,
+    util::Vector3F boxMaxPosition,
+    util::ray_casting::BlockCollisionMask collisionMask,
+    util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn)
+{
+    // block position p overlaps the box if p < boxMaxPosition and p + 1 > boxMinPosition
+    findMatchingBlocksInRoot(
+        rootNode,
+        util::Vector3I32(boxMinPosition),
+        -util::Vector3I32(-boxMaxPosition),
+        [&](const HashlifeNodeBase *node) -> bool
+        {
+            return node->blockSummary.collisionMask & collisionMask;
+        },
+        [&](block::Block block) -> bool
+        {
+            return block::BlockDescriptor::getBlockSummary(block.getBlockKind()).collisionMask
+                   & collisionMask;
+        },
+        fn);
+}
+
+void HashlifeWorld::findBlocksImplementation(
+    const HashlifeNodeBase *rootNode,
+    block::BlockKind blockKind,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 maxPosition,
+    util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn)
+{
+    auto blockKindPresenceBit = HashlifeNodeBase::getBlockKindPresenceBit(blockKind);
+    findMatchingBlocksInRoot(
+        rootNode,
+        minPosition,
+        maxPosition + util::Vector3I32(1),
+        [&](const HashlifeNodeBase *node) -> bool
+        {
+            return node->blockKindPresenceMask & blockKindPresenceBit;
+        },
+        [&](block::Block block) -> bool
+        {
+            return block.getBlockKind() == blockKind;
+        },
+        fn);
+}
+
+void HashlifeWorld::getBlockKindCounts(const HashlifeNodeBase *node,
+                                       util::Vector3I32 nodeMinPosition,
+                                       util::Vector3I32 minPosition,
+                                       util::Vector3I32 endPosition,
+                                       HashlifeBlockKindCounts &blockKindCounts)
+{
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto childSize = node->getHalfSize();
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                auto childMinPosition = nodeMinPosition + index * util::Vector3I32(childSize);
+                auto childEndPosition = childMinPosition + util::Vector3I32(childSize);
+                auto clippedMinPosition = max(minPosition, childMinPosition);
+                auto clippedEndPosition = min(endPosition, childEndPosition);
+                if((clippedMinPosition - clippedEndPosition).max() >= 0)
+                    continue;
+                if(node->isLeaf())
+                    blockKindCounts.add(getAsLeaf(node)->getBlock(index).getBlockKind(), 1);
+                else if(clippedMinPosition == childMinPosition
+                        && clippedEndPosition == childEndPosition)
+                    getAsNonleaf(node)->getChildNode(index)->addBlockKindCounts(blockKindCounts);
+                else
+                    getBlockKindCounts(getAsNonleaf(node)->getChildNode(index).get(),
+                                       childMinPosition,
+                                       minPosition,
+                                       endPosition,
+                                       blockKindCounts);
+            }
+        }
+    }
+}
+
+HashlifeBlockKindCounts HashlifeWorld::getBlockKindCountsImplementation(
+    const HashlifeNodeBase *rootNode, util::Vector3I32 minPosition, util::Vector3I32 maxPosition)
+{
+    HashlifeBlockKindCounts retval;
+    if(minPosition.x > maxPosition.x || minPosition.y > maxPosition.y
+       || minPosition.z > maxPosition.z)
+        return retval;
+    auto getBlockCount = [](util::Vector3I32 minPosition,
+                            util::Vector3I32 maxPosition) -> HashlifeBlockKindCounts::CountType
+    {
+        // computed in 64 bits since maxPosition + 1 can overflow
+        auto size = util::Vector3<HashlifeBlockKindCounts::CountType>(
+            util::Vector3<std::int64_t>(maxPosition) - util::Vector3<std::int64_t>(minPosition)
+            + util::Vector3<std::int64_t>(1));
+        return HashlifeBlockKindCounts::multiplyCounts(
+            HashlifeBlockKindCounts::multiplyCounts(size.x, size.y), size.z);
+    };
+    auto rootMinPosition = util::Vector3I32(-rootNode->getHalfSize());
+    auto rootMaxPosition = util::Vector3I32(rootNode->getHalfSize() - 1);
+    auto clippedMinPosition = max(minPosition, rootMinPosition);
+    auto clippedMaxPosition = min(maxPosition, rootMaxPosition);
+    HashlifeBlockKindCounts::CountType insideBlockCount = 0;
+    if((clippedMinPosition - clippedMaxPosition).max() <= 0)
+    {
+        getBlockKindCounts(rootNode,
+                           rootMinPosition,
+                           clippedMinPosition,
+                           clippedMaxPosition + util::Vector3I32(1),
+                           retval);
+        insideBlockCount = getBlockCount(clippedMinPosition, clippedMaxPosition);
+    }
+    // blocks outside the root are empty
+    auto outsideBlockCount = getBlockCount(minPosition, maxPosition) - insideBlockCount;
+    if(outsideBlockCount != 0)
+        retval.add(block::BlockKind::empty(), outsideBlockCount);
+    return retval;
+}
+
+HashlifeBlockKindCounts::CountType HashlifeWorld::countBlocksImplementation(
+    const HashlifeNodeBase *rootNode,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 maxPosition,
+    util::FunctionReference<bool(block::BlockKind blockKind)> predicate)
+{
+    HashlifeBlockKindCounts::CountType retval = 0;
+    for(auto &count : getBlockKindCountsImplementation(rootNode, minPosition, maxPosition).counts)
+        if(predicate(count.first))
+            retval = HashlifeBlockKindCounts::addCounts(retval, count.second);
+    return retval;
+}
+
+namespace
+{
+/** what one snapshot has in an aligned box that diff is visiting */
+struct DiffSide final
+{
+    /** the node that exactly covers the box, the root if the box is bigger than the root, or null
+     * if the box is entirely outside the root and so is all empty blocks
+     */
+    const HashlifeNodeBase *node;
+    bool isExact;
+    /** get what this snapshot has in the child box at childMinPosition */
+    DiffSide getChild(util::Vector3I32 index,
+                      util::Vector3<std::int64_t> childMinPosition,
+                      HashlifeNodeBase::LevelType childLevel) const
+    {
+        if(!node)
+            return DiffSide{nullptr, false};
+        if(isExact)
+            return DiffSide{getAsNonleaf(node)->getChildNode(index).get(), true};
+        std::int64_t childSize = HashlifeNodeBase::getSize(childLevel);
+        std::int64_t rootHalfSize = node->getHalfSize();
+        auto childEndPosition = childMinPosition + util::Vector3<std::int64_t>(childSize);
+        if((max(childMinPosition, util::Vector3<std::int64_t>(-rootHalfSize))
+            - min(childEndPosition, util::Vector3<std::int64_t>(rootHalfSize)))
+               .max()
+           >= 0)
+            return DiffSide{nullptr, false};
+        // aligned boxes smaller than the root are either inside it or outside it
+        if(childLevel < node->level)
+            return DiffSide{node->get(util::Vector3I32(childMinPosition), childLevel), true};
+        return DiffSide{node, false};
+    }
+    bool isSameAs(const DiffSide &rt) const noexcept
+    {
+        if(isExact && rt.isExact)
+            return node == rt.node;
+        if(!node && !rt.node)
+            return true;
+        auto isEmpty = [](const DiffSide &side)
+        {
+            return side.isExact && side.node->isUniform
+                   && side.node->uniformBlock == block::Block();
+        };
+        return (!node && isEmpty(rt)) || (!rt.node && isEmpty(*this));
+    }
+};
+
+void diffNodes(DiffSide a,
+               DiffSide b,
+               util::Vector3<std::int64_t> minPosition,
+               HashlifeNodeBase::LevelType level,
+               HashlifeNodeBase::LevelType minLevel,
+               std::vector<util::Vector3I32> &changedBoxes)
+{
+    if(a.isSameAs(b))
+        return;
+    if(level <= minLevel)
+    {
+        changedBoxes.push_back(util::Vector3I32(minPosition));
+        return;
+    }
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto childLevel = static_cast<HashlifeNodeBase::LevelType>(level - 1);
+    std::int64_t childSize = HashlifeNodeBase::getSize(childLevel);
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                auto childMinPosition =
+                    minPosition
+                    + util::Vector3<std::int64_t>(index) * util::Vector3<std::int64_t>(childSize);
+                diffNodes(a.getChild(index, childMinPosition, childLevel),
+                          b.getChild(index, childMinPosition, childLevel),
+                          childMinPosition,
+                          childLevel,
+                          minLevel,
+                          changedBoxes);
+            }
+        }
+    }
+}
+}
+
+std::vector<util::Vector3I32> HashlifeWorld::diff(const Snapshot &a,
+                                                  const Snapshot &b,
+                                                  HashlifeNodeBase::LevelType minLevel)
+{
+    std::vector<util::Vector3I32> retval;
+    auto level = std::max(a.rootNode->level, b.rootNode->level);
+    // the root box is centered on the origin, unlike aligned boxes, so start from its children
+    auto minPosition = util::Vector3<std::int64_t>(-HashlifeNodeBase::getHalfSize(level));
+    DiffSide sideA{a.rootNode.get(), a.rootNode->level == level};
+    DiffSide sideB{b.rootNode.get(), b.rootNode->level == level};
+    if(sideA.isSameAs(sideB))
+        return retval;
+    if(level <= minLevel)
+    {
+        // the root isn't aligned, so report the aligned boxes it overlaps
+        std::int32_t boxSize = HashlifeNodeBase::getSize(minLevel);
+        for(util::Vector3I32 position(-boxSize); position.x < boxSize; position.x += boxSize)
+            for(position.y = -boxSize; position.y < boxSize; position.y += boxSize)
+                for(position.z = -boxSize; position.z < boxSize; position.z += boxSize)
+                    retval.push_back(position);
+        return retval;
+    }
+    diffNodes(sideA, sideB, minPosition, level, minLevel, retval);
+    return retval;
+}
+
+struct HashlifeWorld::SweptBoxState final
+{
+    double boxMinPosition[3];
+    double boxMaxPosition[3];
+    double displacement[3];
+    util::ray_casting::BlockCollisionMask collisionMask;
+    SweptBoxState(util::Vector3F boxMinPosition,
+                  util::Vector3F boxMaxPosition,
+                  util::Vector3F displacement,
+                  util::ray_casting::BlockCollisionMask collisionMask)
+        : boxMinPosition{boxMinPosition.x, boxMinPosition.y, boxMinPosition.z},
+          boxMaxPosition{boxMaxPosition.x, boxMaxPosition.y, boxMaxPosition.z},
+          displacement{displacement.x, displacement.y, displacement.z},
+          collisionMask(collisionMask)
+    {
+    }
+    /** get the range of t where the moving box overlaps the region
+     * @param enterAxis set to the axis that the box starts overlapping last, or -1 if the box
+     * overlaps the region for all t
+     * @return true if the box ever overlaps the region
+     */
+    bool getOverlapInterval(util::Vector3I32 regionMinPosition,
+                            double regionSize,
+                            double &enterT,
+                            double &exitT,
+                            int &enterAxis) const noexcept
+    {
+        enterT = -std::numeric_limits<double>::infinity();
+        exitT = std::numeric_limits<double>::infinity();
+        enterAxis = -1;
+        const std::int32_t regionMinPositionArray[3] = {
+            regionMinPosition.x, regionMinPosition.y, regionMinPosition.z,
+        };
+        for(int axis = 0; axis < 3; axis++)
+        {
+            double regionMin = regionMinPositionArray[axis];
+            double regionEnd = regionMin + regionSize;
+            if(displacement[axis] == 0)
+            {
+                if(boxMinPosition[axis] >= regionEnd || boxMaxPosition[axis] <= regionMin)
+                    return false;
+                continue;
+            }
+            double t0 = (regionMin - boxMaxPosition[axis]) / displacement[axis];
+            double t1 = (regionEnd - boxMinPosition[axis]) / displacement[axis];
+            if(t0 > t1)
+                std::swap(t0, t1);
+            if(t0 > enterT)
+            {
+                enterT = t0;
+                enterAxis = axis;
+            }
+            if(t1 < exitT)
+                exitT = t1;
+        }
+        return enterT < exitT;
+    }
+};
+
+void HashlifeWorld::sweepBox(const HashlifeNodeBase *node,
+                             util::Vector3I32 nodeMinPosition,
+                             const SweptBoxState &state,
+                             util::Optional<SweptBoxHit> &hit)
+{
+    if((node->blockSummary.collisionMask & state.collisionMask) == 0)
+        return;
+    struct Child final
+    {
+        double enterT;
+        int enterAxis;
+        util::Vector3I32 index;
+        util::Vector3I32 minPosition;
+    };
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    Child children[HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize
+                   * HashlifeNodeBase::levelSize];
+    std::size_t childCount = 0;
+    auto childSize = node->getHalfSize();
+    for(util::Vector3I32 index(0); index.x < HashlifeNodeBase::levelSize; index.x++)
+    {
+        for(index.y = 0; index.y < HashlifeNodeBase::levelSize; index.y++)
+        {
+            for(index.z = 0; index.z < HashlifeNodeBase::levelSize; index.z++)
+            {
+                Child child;
+                double exitT;
+                child.index = index;
+                child.minPosition = nodeMinPosition + index * util::Vector3I32(childSize);
+                if(!state.getOverlapInterval(
+                       child.minPosition, childSize, child.enterT, exitT, child.enterAxis))
+                    continue;
+                if(exitT <= 0 || child.enterT > 1)
+                    continue;
+                std::size_t insertIndex = childCount++;
+                for(; insertIndex > 0 && children[insertIndex - 1].enterT > child.enterT;
+                    insertIndex--)
+                    children[insertIndex] = children[insertIndex - 1];
+                children[insertIndex] = child;
+            }
+        }
+    }
+    for(std::size_t i = 0; i < childCount; i++)
+    {
+        auto &child = children[i];
+        // children are sorted, so nothing after this can be hit sooner
+        if(hit && child.enterT >= hit->t)
+            break;
+        if(!node->isLeaf())
+        {
+            sweepBox(getAsNonleaf(node)->getChildNode(child.index).get(),
+                     child.minPosition,
+                     state,
+                     hit);
+            continue;
+        }
+        // the box already overlaps this block at the start
+        if(child.enterT < 0)
+            continue;
+        auto block = getAsLeaf(node)->getBlock(child.index);
+        if((block::BlockDescriptor::getBlockSummary(block.getBlockKind()).collisionMask
+            & state.collisionMask) == 0)
+            continue;
+        static constexpr block::BlockFace negativeFaces[3] = {
+            block::BlockFace::NX, block::BlockFace::NY, block::BlockFace::NZ,
+        };
+        auto face = negativeFaces[child.enterAxis];
+        // moving in the positive direction means touching the negative face
+        hit = SweptBoxHit{static_cast<float>(child.enterT),
+                          child.minPosition,
+                          state.displacement[child.enterAxis] > 0 ? face : block::reverse(face),
+                          block};
+        return;
+    }
+}
+
+util::Optional<HashlifeWorld::SweptBoxHit> HashlifeWorld::sweepBoxImplementation(
+    const HashlifeNodeBase *rootNode,
+    util::Vector3F boxMinPosition,
+    util::Vector3F boxMaxPosition,
+    util::Vector3F displacement,
+    util::ray_casting::BlockCollisionMask collisionMask)
+{
+    SweptBoxState state(boxMinPosition, boxMaxPosition, displacement, collisionMask);
+    util::Optional<SweptBoxHit> hit;
+    sweepBox(rootNode, util::Vector3I32(-rootNode->getHalfSize()), state, hit);
+    return hit;
+}
+
+namespace
+{
+/** compare positions by the order that the octree visits them in: z-order with x as the most
+ * significant axis, to match the child index order.
+ */
+bool isBeforeInOctreeOrder(util::Vector3I32 aIn, util::Vector3I32 bIn) noexcept
+{
+    // flip the sign bits so unsigned order matches signed order
+    util::Vector3U32 a(static_cast<std::uint32_t>(aIn.x) ^ 0x80000000UL,
+                       static_cast<std::uint32_t>(aIn.y) ^ 0x80000000UL,
+                       static_cast<std::uint32_t>(aIn.z) ^ 0x80000000UL);
+    util::Vector3U32 b(static_cast<std::uint32_t>(bIn.x) ^ 0x80000000UL,
+                       static_cast<std::uint32_t>(bIn.y) ^ 0x80000000UL,
+                       static_cast<std::uint32_t>(bIn.z) ^ 0x80000000UL);
+    auto difference = a ^ b;
+    // a < b && a < (a ^ b) is true when the most significant set bit of a is less than b's
+    auto isMostSignificantBitLess = [](std::uint32_t a, std::uint32_t b) -> bool
+    {
+        return a < b && a < (a ^ b);
+    };
+    if(isMostSignificantBitLess(difference.x, difference.y))
+    {
+        if(isMostSignificantBitLess(difference.y, difference.z))
+            return a.z < b.z;
+        return a.y < b.y;
+    }
+    if(isMostSignificantBitLess(difference.x, difference.z))
+        return a.z < b.z;
+    return a.x < b.x;
+}
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::applyEdits(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 nodeCenter,
+    const BlockEdit *editsBegin,
+    const BlockEdit *editsEnd)
+{
+    constexprAssert(editsBegin != editsEnd);
+    if(node->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    blocks[position.x][position.y][position.z] =
+                        getAsLeaf(node)->getBlock(position);
+                }
+            }
+        }
+        for(auto edit = editsBegin; edit != editsEnd; ++edit)
+        {
+            auto index = node->getIndex(edit->first - nodeCenter);
+            blocks[index.x][index.y][index.z] = edit->second;
+        }
+        return garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                childNodes[position.x][position.y][position.z] =
+                    getAsNonleaf(node)->getChildNode(position);
+            }
+        }
+    }
+    // edits are sorted in octree order, so the edits for each child are contiguous
+    for(auto childEditsBegin = editsBegin; childEditsBegin != editsEnd;)
+    {
+        auto relativePosition = childEditsBegin->first - nodeCenter;
+        auto index = node->getIndex(relativePosition);
+        auto childEditsEnd = childEditsBegin;
+        do
+        {
+            ++childEditsEnd;
+        } while(childEditsEnd != editsEnd
+                && node->getIndex(childEditsEnd->first - nodeCenter) == index);
+        auto childCenter = nodeCenter + relativePosition - node->getChildPosition(relativePosition);
+        auto &childNode = childNodes[index.x][index.y][index.z];
+        childNode = applyEdits(childNode.get(), childCenter, childEditsBegin, childEditsEnd);
+        childEditsBegin = childEditsEnd;
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+void HashlifeWorld::applyEdits(std::vector<BlockEdit> edits)
+{
+    if(edits.empty())
+        return;
+    auto minPosition = edits.front().first;
+    auto maxPosition = minPosition;
+    for(auto &edit : edits)
+    {
+        minPosition = min(minPosition, edit.first);
+        maxPosition = max(maxPosition, edit.first);
+    }
+    while(!rootNode->isPositionInside(minPosition) || !rootNode->isPositionInside(maxPosition))
+        expandRoot();
+    faultInSubtrees(minPosition, maxPosition);
+    // stable so later edits to the same position stay later and win
+    std::stable_sort(edits.begin(),
+                     edits.end(),
+                     [](const BlockEdit &a, const BlockEdit &b) noexcept
+                     {
+                         return isBeforeInOctreeOrder(a.first, b.first);
+                     });
+    rootNode = applyEdits(
+        rootNode.get(), util::Vector3I32(0), edits.data(), edits.data() + edits.size());
+}
+
+/** the boundary of a large box cuts through many identical nodes at the same offset, so
+ * remember the results while filling
+ */
+struct HashlifeWorld::FillRegionMemo final
+{
+    struct Key final
+    {
+        const HashlifeNodeBase *node;
+        util::Vector3I32 minPosition;
+        util::Vector3I32 endPosition;
+        bool operator==(const Key &rt) const noexcept
+        {
+            return node == rt.node && minPosition == rt.minPosition
+                   && endPosition == rt.endPosition;
+        }
+    };
+    struct KeyHasher final
+    {
+        std::size_t operator()(const Key &key) const
+        {
+            return std::hash<const HashlifeNodeBase *>()(key.node)
+                   + 8191 * std::hash<util::Vector3I32>()(key.minPosition)
+                   + 131071 * std::hash<util::Vector3I32>()(key.endPosition);
+        }
+    };
+    std::unordered_map<Key, HashlifeNodeReference<const HashlifeNodeBase, false>, KeyHasher>
+        results;
+};
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::fillRegion(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 endPosition,
+    block::Block block,
+    FillRegionMemo &memo)
+{
+    constexprAssert((endPosition - minPosition).min() > 0);
+    constexprAssert(node->isPositionInside(minPosition));
+    constexprAssert(node->isPositionInside(endPosition - util::Vector3I32(1)));
+    if(minPosition == util::Vector3I32(-node->getHalfSize())
+       && endPosition == util::Vector3I32(node->getHalfSize()))
+        return garbageCollectedHashtable.getCanonicalUniformNode(block, node->level);
+    auto &result = memo.results[FillRegionMemo::Key{node, minPosition, endPosition}];
+    if(!result)
+        result = fillRegionImplementation(node, minPosition, endPosition, block, memo);
+    return result;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::fillRegionImplementation(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 endPosition,
+    block::Block block,
+    FillRegionMemo &memo)
+{
+    if(node->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    static_assert(HashlifeNodeBase::levelSize % 2 == 0, "");
+                    auto inputPosition =
+                        position - util::Vector3I32(HashlifeNodeBase::levelSize / 2);
+                    if((inputPosition - minPosition).min() < 0
+                       || (inputPosition - endPosition).max() >= 0)
+                        blocks[position.x][position.y][position.z] =
+                            getAsLeaf(node)->getBlock(position);
+                    else
+                        blocks[position.x][position.y][position.z] = block;
+                }
+            }
+        }
+        return garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                static_assert(HashlifeNodeBase::levelSize % 2 == 0, "");
+                auto minChildPosition =
+                    (position - util::Vector3I32(HashlifeNodeBase::levelSize / 2))
+                    * util::Vector3I32(node->getHalfSize());
+                auto childCenter = minChildPosition + util::Vector3I32(node->getQuarterSize());
+                auto endChildPosition = minChildPosition + util::Vector3I32(node->getHalfSize());
+                minChildPosition = max(minChildPosition, minPosition);
+                endChildPosition = min(endChildPosition, endPosition);
+                if((endChildPosition - minChildPosition).min() > 0)
+                    childNodes[position.x][position.y][position.z] =
+                        fillRegion(getAsNonleaf(node)->getChildNode(position).get(),
+                                   minChildPosition - childCenter,
+                                   endChildPosition - childCenter,
+                                   block,
+                                   memo);
+                else
+                    childNodes[position.x][position.y][position.z] =
+                        getAsNonleaf(node)->getChildNode(position);
+            }
+        }
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+void HashlifeWorld::fillRegion(util::Vector3I32 minPosition,
+                               util::Vector3I32 maxPosition,
+                               block::Block block)
+{
+    if((maxPosition - minPosition).min() < 0)
+        return;
+    while(!rootNode->isPositionInside(minPosition) || !rootNode->isPositionInside(maxPosition))
+        expandRoot();
+    faultInSubtrees(minPosition, maxPosition);
+    FillRegionMemo memo;
+    rootNode =
+        fillRegion(rootNode.get(), minPosition, maxPosition + util::Vector3I32(1), block, memo);
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::transformNode(
+    const HashlifeNodeBase *node, block::BlockTransform blockTransform)
+{
+    if(blockTransform.isIdentity())
+        return node->referenceFromThis<false>();
+    auto &result =
+        transformedNodes[TransformedNodeKey{node->referenceFromThis<false>(), blockTransform}];
+    if(result)
+        return result;
+    // child indexes are block positions in a 2x2x2 grid centered on 0, offset by 1
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    auto indexOffset = util::Vector3I32(HashlifeNodeBase::levelSize / 2);
+    if(node->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    auto newPosition =
+                        blockTransform.transformBlockPosition(position - indexOffset)
+                        + indexOffset;
+                    blocks[newPosition.x][newPosition.y][newPosition.z] =
+                        block::BlockDescriptor::getTransformedBlock(
+                            getAsLeaf(node)->getBlock(position), blockTransform);
+                }
+            }
+        }
+        result = garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+        return result;
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                auto newPosition =
+                    blockTransform.transformBlockPosition(position - indexOffset) + indexOffset;
+                childNodes[newPosition.x][newPosition.y][newPosition.z] = transformNode(
+                    getAsNonleaf(node)->getChildNode(position).get(), blockTransform);
+            }
+        }
+    }
+    result = garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+    return result;
+}
+
+struct HashlifeWorld::CopyRegionState final
+{
+    /** the root before copying; the source is read from here */
+    HashlifeNodeReference<const HashlifeNodeBase, false> sourceRoot;
+    /** destination position minus transformed source position */
+    util::Vector3I32 offset;
+    /** transform applied to the source around the origin */
+    block::BlockTransform blockTransform;
+    block::BlockTransform inverseBlockTransform;
+    struct ShiftKey final
+    {
+        HashlifeNonleafNode::ChildNodesArray nodes;
+        util::Vector3I32 offset;
+        bool operator==(const ShiftKey &rt) const noexcept
+        {
+            return nodes == rt.nodes && offset == rt.offset;
+        }
+    };
+    struct ShiftKeyHasher final
+    {
+        std::size_t operator()(const ShiftKey &key) const
+        {
+            return HashlifeNonleafNode::hashNode(key.nodes) * 8191
+                   + std::hash<util::Vector3I32>()(key.offset);
+        }
+    };
+    std::unordered_map<ShiftKey,
+                       HashlifeNodeReference<const HashlifeNodeBase, false>,
+                       ShiftKeyHasher> shiftedNodes;
+    CopyRegionState(HashlifeNodeReference<const HashlifeNodeBase, false> sourceRoot,
+                    util::Vector3I32 offset,
+                    block::BlockTransform blockTransform)
+        : sourceRoot(std::move(sourceRoot)),
+          offset(offset),
+          blockTransform(blockTransform),
+          inverseBlockTransform(blockTransform.inverse()),
+          shiftedNodes()
+    {
+    }
+    block::Block getSourceBlock(util::Vector3I32 position) const
+    {
+        position = inverseBlockTransform.transformBlockPosition(position);
+        if(!sourceRoot->isPositionInside(position))
+            return block::Block();
+        return block::BlockDescriptor::getTransformedBlock(sourceRoot->get(position),
+                                                           blockTransform);
+    }
+};
+
+/** get the aligned transformed source node with the specified level whose minimum corner is
+ * minPosition
+ */
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::getCopyRegionSourceNode(
+    CopyRegionState &state, HashlifeNodeBase::LevelType level, util::Vector3I32 minPosition)
+{
+    constexprAssert(level < state.sourceRoot->level);
+    // transforms around the origin map aligned nodes to aligned nodes
+    auto maxPosition =
+        minPosition + util::Vector3I32(static_cast<std::int32_t>(HashlifeNodeBase::getSize(level)))
+        - util::Vector3I32(1);
+    minPosition = min(state.inverseBlockTransform.transformBlockPosition(minPosition),
+                      state.inverseBlockTransform.transformBlockPosition(maxPosition));
+    auto center = minPosition + util::Vector3I32(HashlifeNodeBase::getHalfSize(level));
+    if(!state.sourceRoot->isPositionInside(center))
+        return garbageCollectedHashtable.getCanonicalEmptyNode(level);
+    return transformNode(state.sourceRoot->get(center, level), state.blockTransform);
+}
+
+/** get the node that covers the box starting at offset out of the box made from the 2x2x2
+ * aligned nodes
+ */
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::shiftNodes(
+    CopyRegionState &state,
+    const HashlifeNonleafNode::ChildNodesArray &nodes,
+    util::Vector3I32 offset)
+{
+    if(offset == util::Vector3I32(0))
+        return nodes[0][0][0];
+    auto &result = state.shiftedNodes[CopyRegionState::ShiftKey{nodes, offset}];
+    if(result)
+        return result;
+    static_assert(HashlifeNodeBase::levelSize == 2, "");
+    static constexpr std::int32_t gridSize = HashlifeNodeBase::levelSize * 2;
+    if(nodes[0][0][0]->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    auto gridPosition = position + offset;
+                    constexprAssert(gridPosition.max() < gridSize);
+                    auto index1 = gridPosition / util::Vector3I32(HashlifeNodeBase::levelSize);
+                    auto index2 = gridPosition % util::Vector3I32(HashlifeNodeBase::levelSize);
+                    blocks[position.x][position.y][position.z] =
+                        getAsLeaf(nodes[index1.x][index1.y][index1.z].get())->getBlock(index2);
+                }
+            }
+        }
+        result = garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+        return result;
+    }
+    auto childSize = nodes[0][0][0]->getHalfSize();
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                auto childPosition = position * util::Vector3I32(childSize) + offset;
+                auto gridStart = childPosition / util::Vector3I32(childSize);
+                HashlifeNonleafNode::ChildNodesArray grandchildNodes;
+                for(util::Vector3I32 position2(0); position2.x < HashlifeNodeBase::levelSize;
+                    position2.x++)
+                {
+                    for(position2.y = 0; position2.y < HashlifeNodeBase::levelSize; position2.y++)
+                    {
+                        for(position2.z = 0; position2.z < HashlifeNodeBase::levelSize;
+                            position2.z++)
+                        {
+                            auto gridPosition = gridStart + position2;
+                            constexprAssert(gridPosition.max() < gridSize);
+                            auto index1 =
+                                gridPosition / util::Vector3I32(HashlifeNodeBase::levelSize);
+                            auto index2 =
+                                gridPosition % util::Vector3I32(HashlifeNodeBase::levelSize);
+                            grandchildNodes[position2.x][position2.y][position2.z] =
+                                getAsNonleaf(nodes[index1.x][index1.y][index1.z].get())
+                                    ->getChildNode(index2);
+                        }
+                    }
+                }
+                childNodes[position.x][position.y][position.z] =
+                    shiftNodes(state, grandchildNodes, childPosition % util::Vector3I32(childSize));
+            }
+        }
+    }
+    result = garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+    return result;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::copyRegion(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 nodeCenter,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 endPosition,
+    CopyRegionState &state)
+{
+    auto nodeMinPosition = nodeCenter - util::Vector3I32(node->getHalfSize());
+    auto nodeEndPosition = nodeCenter + util::Vector3I32(node->getHalfSize());
+    constexprAssert((endPosition - minPosition).min() > 0);
+    constexprAssert((minPosition - nodeMinPosition).min() >= 0);
+    constexprAssert((nodeEndPosition - endPosition).min() >= 0);
+    if(minPosition == nodeMinPosition && endPosition == nodeEndPosition)
+    {
+        auto sourceMinPosition = nodeMinPosition - state.offset;
+        auto size = util::Vector3I32(static_cast<std::int32_t>(node->getSize()));
+        // round down to a multiple of size
+        auto alignedMinPosition = sourceMinPosition - (sourceMinPosition % size + size) % size;
+        HashlifeNonleafNode::ChildNodesArray nodes;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    nodes[position.x][position.y][position.z] = getCopyRegionSourceNode(
+                        state, node->level, alignedMinPosition + position * size);
+                }
+            }
+        }
+        return shiftNodes(state, nodes, sourceMinPosition - alignedMinPosition);
+    }
+    if(node->isLeaf())
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    auto blockPosition = nodeMinPosition + position;
+                    if((blockPosition - minPosition).min() < 0
+                       || (blockPosition - endPosition).max() >= 0)
+                        blocks[position.x][position.y][position.z] =
+                            getAsLeaf(node)->getBlock(position);
+                    else
+                        blocks[position.x][position.y][position.z] =
+                            state.getSourceBlock(blockPosition - state.offset);
+                }
+            }
+        }
+        return garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                auto minChildPosition =
+                    nodeMinPosition + position * util::Vector3I32(node->getHalfSize());
+                auto childCenter = minChildPosition + util::Vector3I32(node->getQuarterSize());
+                auto endChildPosition = minChildPosition + util::Vector3I32(node->getHalfSize());
+                minChildPosition = max(minChildPosition, minPosition);
+                endChildPosition = min(endChildPosition, endPosition);
+                if((endChildPosition - minChildPosition).min() > 0)
+                    childNodes[position.x][position.y][position.z] =
+                        copyRegion(getAsNonleaf(node)->getChildNode(position).get(),
+                                   childCenter,
+                                   minChildPosition,
+                                   endChildPosition,
+                                   state);
+                else
+                    childNodes[position.x][position.y][position.z] =
+                        getAsNonleaf(node)->getChildNode(position);
+            }
+        }
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+void HashlifeWorld::copyRegion(util::Vector3I32 sourceMinPosition,
+                               util::Vector3I32 sourceMaxPosition,
+                               util::Vector3I32 destinationMinPosition)
+{
+    transformRegion(sourceMinPosition,
+                    sourceMaxPosition,
+                    block::BlockTransform::identity(),
+                    destinationMinPosition);
+}
+
+void HashlifeWorld::transformRegion(util::Vector3I32 sourceMinPosition,
+                                    util::Vector3I32 sourceMaxPosition,
+                                    block::BlockTransform blockTransform,
+                                    util::Vector3I32 destinationMinPosition)
+{
+    if((sourceMaxPosition - sourceMinPosition).min() < 0)
+        return;
+    auto transformedMinPosition = min(blockTransform.transformBlockPosition(sourceMinPosition),
+                                      blockTransform.transformBlockPosition(sourceMaxPosition));
+    auto transformedMaxPosition = max(blockTransform.transformBlockPosition(sourceMinPosition),
+                                      blockTransform.transformBlockPosition(sourceMaxPosition));
+    auto destinationMaxPosition =
+        destinationMinPosition + (transformedMaxPosition - transformedMinPosition);
+    while(!rootNode->isPositionInside(sourceMinPosition)
+          || !rootNode->isPositionInside(sourceMaxPosition)
+          || !rootNode->isPositionInside(destinationMinPosition)
+          || !rootNode->isPositionInside(destinationMaxPosition))
+        expandRoot();
+    // expand once more so all the source nodes we need are strictly smaller than the root
+    expandRoot();
+    faultInSubtrees(sourceMinPosition, sourceMaxPosition);
+    faultInSubtrees(destinationMinPosition, destinationMaxPosition);
+    CopyRegionState state(
+        rootNode, destinationMinPosition - transformedMinPosition, blockTransform);
+    rootNode = copyRegion(rootNode.get(),
+                          util::Vector3I32(0),
+                          destinationMinPosition,
+                          destinationMaxPosition + util::Vector3I32(1),
+                          state);
+}
+
 void HashlifeWorld::dumpNode(HashlifeNodeReference<const HashlifeNodeBase, true> node,
                              std::ostream &os)
 {
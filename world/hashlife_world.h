@@ -29,10 +29,18 @@
 #include "../util/constexpr_array.h"
 #include "../util/vector.h"
 #include "../util/function_reference.h"
+#include "../util/ray_casting.h"
+#include "../util/optional.h"
+#include "../io/input_stream.h"
+#include "../io/output_stream.h"
+#include "../io/mapped_file.h"
+#include "../io/file_stream.h"
 #include <memory>
 #include <list>
+#include <vector>
 #include <iosfwd>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <type_traits>
 #include <mutex>
@@ -122,6 +130,20 @@ private:
             }
             return true;
         }
+        /** hash of the nodes and global state that is the same in different processes
+         * @see HashlifeNodeBase::contentHash
+         */
+        std::uint64_t getContentHash() const noexcept
+        {
+            auto retval = HashlifeNodeBase::combineContentHash(
+                HashlifeNodeBase::contentHashInitialValue,
+                blockStepGlobalState.lightingGlobalProperties.skylight);
+            for(unsigned char ch : blockStepGlobalState.getDimension().getName())
+                retval = HashlifeNodeBase::combineContentHash(retval, ch);
+            for(auto &node : nodes)
+                retval = HashlifeNodeBase::combineContentHash(retval, node->contentHash);
+            return retval;
+        }
         block::Block getBlock(util::Vector3I32 position) const noexcept
         {
             position += util::Vector3I32(renderCacheCenterSize);
@@ -248,9 +270,100 @@ private:
     }
 
 public:
+    struct RayCastHit final
+    {
+        float t;
+        util::Vector3I32 blockPosition;
+        /** the face the ray entered the block through; empty if the ray started inside it */
+        util::Optional<block::BlockFace> blockFace;
+        block::Block block;
+    };
+
+private:
+    struct RayCastState;
+    static bool castRay(const HashlifeNodeBase *node,
+                        util::Vector3I32 nodeMinPosition,
+                        const RayCastState &state,
+                        RayCastHit &hit);
+    /** find the first block along ray that isn't rendered like air.
+     * skips whole subtrees whose BlockSummary says they are rendered like air.
+     */
+    static util::Optional<RayCastHit> castRayImplementation(const HashlifeNodeBase *rootNode,
+                                                            const util::ray_casting::Ray &ray,
+                                                            float maxT);
+    /** skips whole subtrees whose BlockSummary has no blocks that collide with collisionMask */
+    static void findCollidingBlocksImplementation(
+        const HashlifeNodeBase *rootNode,
+        util::Vector3F boxMinPosition,
+        util::Vector3F boxMaxPosition,
+        util::ray_casting::BlockCollisionMask collisionMask,
+        util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn);
+    /** skips whole subtrees whose blockKindPresenceMask doesn't have blockKind */
+    static void findBlocksImplementation(
+        const HashlifeNodeBase *rootNode,
+        block::BlockKind blockKind,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition,
+        util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn);
+
+    static void getBlockKindCounts(const HashlifeNodeBase *node,
+                                   util::Vector3I32 nodeMinPosition,
+                                   util::Vector3I32 minPosition,
+                                   util::Vector3I32 endPosition,
+                                   HashlifeBlockKindCounts &blockKindCounts);
+    /** uses the counts memoized on nodes that are entirely inside the region */
+    static HashlifeBlockKindCounts getBlockKindCountsImplementation(
+        const HashlifeNodeBase *rootNode,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition);
+    static HashlifeBlockKindCounts::CountType countBlocksImplementation(
+        const HashlifeNodeBase *rootNode,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition,
+        util::FunctionReference<bool(block::BlockKind blockKind)> predicate);
+
+public:
+    struct SweptBoxHit final
+    {
+        /** the fraction of the displacement that the box moved before touching the block */
+        float t;
+        util::Vector3I32 blockPosition;
+        /** the face of the block that the box touched */
+        block::BlockFace blockFace;
+        block::Block block;
+    };
+
+private:
+    struct SweptBoxState;
+    static void sweepBox(const HashlifeNodeBase *node,
+                         util::Vector3I32 nodeMinPosition,
+                         const SweptBoxState &state,
+                         util::Optional<SweptBoxHit> &hit);
+    static util::Optional<SweptBoxHit> sweepBoxImplementation(
+        const HashlifeNodeBase *rootNode,
+        util::Vector3F boxMinPosition,
+        util::Vector3F boxMaxPosition,
+        util::Vector3F displacement,
+        util::ray_casting::BlockCollisionMask collisionMask);
+    struct RayPacketState;
+    static void castRayPacket(const HashlifeNodeBase *node,
+                              util::Vector3I32 nodeMinPosition,
+                              std::uint32_t activeMask,
+                              RayPacketState &state);
+    /** cast many rays at once, tracing rays with the same direction signs together in packets so
+     * they share node lookups.
+     */
+    static std::vector<util::Optional<RayCastHit>> castRaysImplementation(
+        const HashlifeNodeBase *rootNode,
+        const std::vector<util::ray_casting::Ray> &rays,
+        float maxT);
+
+public:
+    class SnapshotCursor;
     class Snapshot final
     {
         friend class HashlifeWorld;
+        friend class SnapshotCursor;
         Snapshot(const Snapshot &) = delete;
         Snapshot &operator=(const Snapshot &) = delete;
 
@@ -264,6 +377,15 @@ public:
         {
         }
         ~Snapshot() = default;
+        /** true if this snapshot has stubs for subtrees evicted by evictSubtrees.
+         * The blocks in them must not be read from the snapshot, and it can't be written to a
+         * world file.
+         * @see HashlifeNodeBase::isStub
+         */
+        bool hasEvictedSubtrees() const noexcept
+        {
+            return rootNode->hasStubs;
+        }
         block::Block get(util::Vector3I32 position) const noexcept
         {
             return getBlock(rootNode.get(), position);
@@ -272,6 +394,13 @@ public:
         {
             return util::Vector3I32(-rootNode->getHalfSize());
         }
+        /** equal for snapshots with the same size and blocks, even from different processes
+         * @see HashlifeNodeBase::contentHash
+         */
+        std::uint64_t getContentHash() const noexcept
+        {
+            return rootNode->contentHash;
+        }
         util::Vector3I32 endPosition() const noexcept
         {
             return util::Vector3I32(rootNode->getHalfSize());
@@ -284,6 +413,81 @@ public:
         {
             dumpNode(rootNode, os);
         }
+        /** find the first block along ray that isn't rendered like air, up to maxT.
+         * returns the same block as walking a util::ray_casting::RayBlockIterator, including when
+         * the ray passes exactly through block edges or corners, but skips subtrees that are
+         * rendered like air. t is computed in double instead of being accumulated in float, so
+         * where the ray crosses two block boundaries less than float rounding apart the blocks
+         * can still be visited in the other order.
+         */
+        util::Optional<RayCastHit> castRay(const util::ray_casting::Ray &ray, float maxT) const
+        {
+            return castRayImplementation(rootNode.get(), ray, maxT);
+        }
+        /** cast each ray in rays, returning the hits in the same order.
+         * gives the same results as calling castRay for each ray, but is faster for large numbers
+         * of rays.
+         */
+        std::vector<util::Optional<RayCastHit>> castRays(
+            const std::vector<util::ray_casting::Ray> &rays, float maxT) const
+        {
+            return castRaysImplementation(rootNode.get(), rays, maxT);
+        }
+        /** call fn for each block that collides with collisionMask and overlaps the box from
+         * boxMinPosition to boxMaxPosition. Blocks that only touch the surface of the box don't
+         * overlap it.
+         */
+        void findCollidingBlocks(
+            util::Vector3F boxMinPosition,
+            util::Vector3F boxMaxPosition,
+            util::ray_casting::BlockCollisionMask collisionMask,
+            util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn) const
+        {
+            findCollidingBlocksImplementation(
+                rootNode.get(), boxMinPosition, boxMaxPosition, collisionMask, fn);
+        }
+        /** call fn for each block of kind blockKind from minPosition to maxPosition inclusive.
+         * the time taken is proportional to the number of blocks found, not the region volume.
+         */
+        void findBlocks(
+            block::BlockKind blockKind,
+            util::Vector3I32 minPosition,
+            util::Vector3I32 maxPosition,
+            util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn) const
+        {
+            findBlocksImplementation(rootNode.get(), blockKind, minPosition, maxPosition, fn);
+        }
+        /** get the number of blocks of each kind from minPosition to maxPosition inclusive.
+         * blocks outside the world are counted as the empty block kind.
+         */
+        HashlifeBlockKindCounts getBlockKindCounts(util::Vector3I32 minPosition,
+                                                   util::Vector3I32 maxPosition) const
+        {
+            return getBlockKindCountsImplementation(rootNode.get(), minPosition, maxPosition);
+        }
+        /** count the blocks from minPosition to maxPosition inclusive whose kind matches
+         * predicate. predicate is called once per block kind present, not once per block.
+         */
+        HashlifeBlockKindCounts::CountType countBlocks(
+            util::Vector3I32 minPosition,
+            util::Vector3I32 maxPosition,
+            util::FunctionReference<bool(block::BlockKind blockKind)> predicate) const
+        {
+            return countBlocksImplementation(rootNode.get(), minPosition, maxPosition, predicate);
+        }
+        /** move the box from boxMinPosition to boxMaxPosition by displacement, and find the first
+         * block that collides with collisionMask that it touches. Blocks that already overlap the
+         * box at the start are ignored so boxes can move out of blocks they are stuck in.
+         */
+        util::Optional<SweptBoxHit> sweepBox(util::Vector3F boxMinPosition,
+                                             util::Vector3F boxMaxPosition,
+                                             util::Vector3F displacement,
+                                             util::ray_casting::BlockCollisionMask collisionMask)
+            const
+        {
+            return sweepBoxImplementation(
+                rootNode.get(), boxMinPosition, boxMaxPosition, displacement, collisionMask);
+        }
         template <typename BlocksArray>
         void getBlocks(BlocksArray &&blocksArray,
                        util::Vector3I32 worldPosition,
@@ -297,6 +501,443 @@ public:
                       size);
         }
     };
+    /** find the parts of the world that differ between a and b.
+     * walks both trees together and skips the subtrees they share, so the time taken is
+     * proportional to the number of changed nodes times the tree depth.
+     * @return the minimum corners of the changed boxes. Each box is
+     * HashlifeNodeBase::getSize(minLevel) blocks on a side and aligned to a multiple of its size.
+     */
+    static std::vector<util::Vector3I32> diff(const Snapshot &a,
+                                              const Snapshot &b,
+                                              HashlifeNodeBase::LevelType minLevel);
+    /** write snapshot in the binary world format.
+     * Each distinct node is written once, after its children, and refers to them by index, so
+     * the time taken and the size written is proportional to the number of distinct nodes
+     * instead of the number of blocks. Block kinds are written by name.
+     * Blocks are written as indexes into a palette and children as the distance back to them,
+     * both as variable length integers.
+     * @param useCompression if the nodes are compressed using io::LZCompressingOutputStream
+     * @throw io::IOError if snapshot.hasEvictedSubtrees()
+     */
+    static void writeSnapshot(const Snapshot &snapshot,
+                              io::OutputStream &os,
+                              bool useCompression = false);
+    /** write snapshot like writeSnapshot, adding a memo section with the futures memoized in
+     * this world so stepping a world loaded from it doesn't start with a cold cache.
+     * The memo is ignored when loaded by code with a different
+     * block::BlockDescriptor::getStepFingerprint.
+     * @note snapshot must be from this world
+     */
+    void writeSnapshotAndMemo(const Snapshot &snapshot,
+                              io::OutputStream &os,
+                              bool useCompression = false) const;
+    /** read a snapshot written by writeSnapshot or writeSnapshotAndMemo into this world,
+     * restoring the memoized futures of nodes that don't already have one once the whole snapshot
+     * is read
+     * @throw io::IOError if the data isn't valid or names a block kind that doesn't exist
+     */
+    std::shared_ptr<const Snapshot> readSnapshot(io::InputStream &is);
+
+private:
+    std::shared_ptr<const Snapshot> readSnapshotBody(io::InputStream &is, std::uint32_t flags);
+
+public:
+    /** write snapshot in the memory mappable world format read by MappedWorldFile.
+     * Nodes are written as fixed size records sorted by level, with 32-bit child indexes and a
+     * content hash, so they can be read in place without parsing the whole file.
+     */
+    static void writeMappedSnapshot(const Snapshot &snapshot, io::OutputStream &os);
+    /** a world file written by writeMappedSnapshot, read in place from memory.
+     * Only the header is read when opening it; nodes are read when a region containing them is
+     * materialized or faulted in, so opening a file takes the same time no matter how big the
+     * world is.
+     */
+    class MappedWorldFile final
+    {
+        friend class HashlifeWorld;
+        MappedWorldFile(const MappedWorldFile &) = delete;
+        MappedWorldFile &operator=(const MappedWorldFile &) = delete;
+
+    public:
+        static constexpr std::size_t nodeRecordSize = 40;
+
+    private:
+        struct LevelIndexEntry final
+        {
+            std::uint32_t firstNodeIndex;
+            std::uint32_t nodeCount;
+        };
+
+    private:
+        std::shared_ptr<const io::MappedFile> file;
+        std::vector<block::BlockKind> blockKinds;
+        std::vector<LevelIndexEntry> levelIndex;
+        const unsigned char *nodeRecords;
+        std::uint32_t nodeCount;
+        const HashlifeWorld *world;
+        /** nodes whose whole subtree has been materialized */
+        std::unordered_map<std::uint32_t, HashlifeNodeReference<const HashlifeNodeBase, false>>
+            materializedNodes;
+
+    private:
+        static std::uint32_t readU32(const unsigned char *bytes) noexcept
+        {
+            return static_cast<std::uint32_t>(bytes[0])
+                   | (static_cast<std::uint32_t>(bytes[1]) << 8)
+                   | (static_cast<std::uint32_t>(bytes[2]) << 16)
+                   | (static_cast<std::uint32_t>(bytes[3]) << 24);
+        }
+        const unsigned char *getNodeRecord(std::uint32_t nodeIndex) const noexcept
+        {
+            constexprAssert(nodeIndex < nodeCount);
+            return nodeRecords + nodeRecordSize * static_cast<std::size_t>(nodeIndex);
+        }
+
+    public:
+        /** @throw io::IOError if the header isn't valid or names a block kind that doesn't exist
+         */
+        explicit MappedWorldFile(std::shared_ptr<const io::MappedFile> file);
+        std::uint32_t getNodeCount() const noexcept
+        {
+            return nodeCount;
+        }
+        HashlifeNodeBase::LevelType getRootLevel() const noexcept
+        {
+            return levelIndex.size() - 1;
+        }
+        std::uint32_t getRootNodeIndex() const noexcept
+        {
+            return nodeCount - 1;
+        }
+        /** get the range of node indexes at level */
+        std::pair<std::uint32_t, std::uint32_t> getLevelNodeIndexes(
+            HashlifeNodeBase::LevelType level) const noexcept
+        {
+            constexprAssert(level < levelIndex.size());
+            return std::pair<std::uint32_t, std::uint32_t>(
+                levelIndex[level].firstNodeIndex,
+                levelIndex[level].firstNodeIndex + levelIndex[level].nodeCount);
+        }
+        /** @see HashlifeNodeBase::contentHash */
+        std::uint64_t getNodeContentHash(std::uint32_t nodeIndex) const noexcept
+        {
+            auto record = getNodeRecord(nodeIndex);
+            return static_cast<std::uint64_t>(readU32(record + 32))
+                   | (static_cast<std::uint64_t>(readU32(record + 36)) << 32);
+        }
+        std::size_t getMaterializedNodeCount() const noexcept
+        {
+            return materializedNodes.size();
+        }
+    };
+    /** make a snapshot of the world in file with the blocks from minPosition to maxPosition
+     * inclusive read into memory. The rest of the world is left as stubs, like the subtrees
+     * evicted by evictSubtrees, so after restoreSnapshot the other regions are read from file
+     * when they are faulted in. Nodes already materialized from file are reused instead of being
+     * read again, so the time taken is proportional to the size of the region instead of the
+     * world.
+     * @param file must only be used with this world
+     * @throw io::IOError if the nodes read aren't valid
+     */
+    std::shared_ptr<const Snapshot> materializeRegion(const std::shared_ptr<MappedWorldFile> &file,
+                                                      util::Vector3I32 minPosition,
+                                                      util::Vector3I32 maxPosition);
+
+private:
+    /** read the node at nodeIndex from file, leaving its descendants that don't overlap the
+     * region as stubs */
+    HashlifeNodeReference<const HashlifeNodeBase, false> readMappedNode(
+        const std::shared_ptr<MappedWorldFile> &file,
+        std::uint32_t nodeIndex,
+        HashlifeNodeBase::LevelType level,
+        util::Vector3I32 nodeMinPosition,
+        util::Vector3<std::int64_t> regionMinPosition,
+        util::Vector3<std::int64_t> regionEndPosition);
+    /** get the node at nodeIndex from file if it's already materialized, or a stub for it if it
+     * doesn't overlap the region, otherwise read it using readMappedNode */
+    HashlifeNodeReference<const HashlifeNodeBase, false> materializeNode(
+        const std::shared_ptr<MappedWorldFile> &file,
+        std::uint32_t nodeIndex,
+        HashlifeNodeBase::LevelType level,
+        util::Vector3I32 nodeMinPosition,
+        util::Vector3<std::int64_t> regionMinPosition,
+        util::Vector3<std::int64_t> regionEndPosition);
+
+public:
+    /** the state of an append-only world log written by appendSnapshot.
+     * Nodes can't change, so each save only needs to write the nodes that haven't been written to
+     * the log before, followed by a record naming the new root. The nodes already in the log are
+     * kept alive by this object until it is reset.
+     * @note the nodes are kept alive with non-atomic references, so an AppendLog must only be
+     * used on the thread that owns the world the snapshots come from, unlike writeSnapshot.
+     */
+    class AppendLog final
+    {
+        friend class HashlifeWorld;
+        AppendLog(const AppendLog &) = delete;
+        AppendLog &operator=(const AppendLog &) = delete;
+
+    public:
+        /** needsCompaction returns true once the log is this many times bigger than it was right
+         * after the last compaction */
+        static constexpr std::uint64_t compactionGrowthFactor = 4;
+
+    private:
+        std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> persistedNodes;
+        std::unordered_map<const HashlifeNodeBase *, std::uint32_t> persistedNodeIndexes;
+        std::unordered_map<block::BlockKind::ValueType, std::uint32_t> persistedBlockKindIndexes;
+        std::uint64_t logSize;
+        std::uint64_t compactedLogSize;
+
+    public:
+        AppendLog()
+            : persistedNodes(),
+              persistedNodeIndexes(),
+              persistedBlockKindIndexes(),
+              logSize(0),
+              compactedLogSize(0)
+        {
+        }
+        /** forget everything written, so the next appendSnapshot starts a new log */
+        void reset() noexcept
+        {
+            persistedNodes.clear();
+            persistedNodeIndexes.clear();
+            persistedBlockKindIndexes.clear();
+            logSize = 0;
+            compactedLogSize = 0;
+        }
+        std::size_t getPersistedNodeCount() const noexcept
+        {
+            return persistedNodes.size();
+        }
+        /** the number of bytes written to the log since it was started */
+        std::uint64_t getLogSize() const noexcept
+        {
+            return logSize;
+        }
+        /** check if the log has grown enough that it should be rewritten by compactAppendLog */
+        bool needsCompaction() const noexcept
+        {
+            return logSize > compactedLogSize * compactionGrowthFactor;
+        }
+    };
+    /** append the nodes in snapshot that aren't already in log to os, then a record that makes
+     * snapshot's root the current root. The log header is written if log is empty.
+     * To continue a log after restarting, fill log with readAppendLog(is, log) and append to the
+     * end of the valid part of the file.
+     * @note must be called on the thread that owns the world snapshot is from
+     * @see AppendLog
+     * @return the number of bytes written
+     */
+    static std::uint64_t appendSnapshot(AppendLog &log,
+                                        const Snapshot &snapshot,
+                                        io::OutputStream &os);
+    /** start a new log in os with only the nodes that snapshot uses, dropping the records that
+     * aren't reachable anymore. os should replace the old log once this returns.
+     * @return the number of bytes written
+     */
+    static std::uint64_t compactAppendLog(AppendLog &log,
+                                          const Snapshot &snapshot,
+                                          io::OutputStream &os);
+    /** read the last complete root from a log written by appendSnapshot. A partly written record
+     * at the end of the log, from being interrupted while saving, is ignored.
+     * @throw io::IOError if the log isn't valid or doesn't have a complete root
+     */
+    std::shared_ptr<const Snapshot> readAppendLog(io::InputStream &is);
+    /** read a log like readAppendLog(is), and set log to the state it had after writing the last
+     * complete root, so appendSnapshot can continue it. log.getLogSize() is then the size of the
+     * valid part of the log; if the log is longer, the rest is a partly written record that must
+     * be cut off, or replaced by using compactAppendLog, before appending.
+     * @throw io::IOError if the log isn't valid or doesn't have a complete root
+     */
+    std::shared_ptr<const Snapshot> readAppendLog(io::InputStream &is, AppendLog &log);
+
+private:
+    static std::uint32_t appendNode(AppendLog &log,
+                                    const HashlifeNodeBase *node,
+                                    io::OutputStream &os);
+
+public:
+    /** a file that evictSubtrees writes cold subtrees to, so they can be freed from memory, and
+     * that they are faulted back in from.
+     * @note the file only grows, even once the subtrees written to it are replaced; use a new
+     * SpillFile to start over.
+     */
+    class SpillFile final
+    {
+        friend class HashlifeWorld;
+        SpillFile(const SpillFile &) = delete;
+        SpillFile &operator=(const SpillFile &) = delete;
+
+    private:
+        std::string fileName;
+        io::FileOutputStream outputStream;
+        std::uint64_t fileSize;
+        /** the file as of the last fault; null if it has been written to since */
+        std::shared_ptr<const io::MappedFile> mappedFile;
+
+    public:
+        /** create or truncate fileName */
+        explicit SpillFile(std::string fileName)
+            : fileName(fileName), outputStream(std::move(fileName)), fileSize(0), mappedFile()
+        {
+        }
+        std::uint64_t getFileSize() const noexcept
+        {
+            return fileSize;
+        }
+    };
+    /** write the nodes of size HashlifeNodeBase::getSize(level) that don't overlap any of
+     * activeRegions to spillFile, and replace them with stubs (see HashlifeNodeBase::isStub).
+     * Nodes that are uniform are left alone since they don't take any memory, as are nodes that
+     * already have stubs in them.
+     * The evicted nodes are freed by the next garbage collection once no snapshots use them;
+     * snapshots made before this keep them in memory.
+     * @note
+     * step, getRenderCacheEntry, and the functions that change blocks fault back in the evicted
+     * subtrees they need first, as do findPeriod, fastForward, and predictRegion for the
+     * snapshots they are given. Everything else that reads blocks, including get, getBlocks,
+     * countBlocks, findBlocks, castRay, diff, and Snapshot's functions, must not be used on an
+     * evicted region until faultInSubtrees reads it back. Snapshots made meanwhile report
+     * hasEvictedSubtrees, and writeSnapshot, writeSnapshotAndMemo, writeMappedSnapshot, and
+     * appendSnapshot refuse to write them, since the spill file is only scratch space.
+     * @param activeRegions the minimum and maximum (inclusive) positions of the boxes to keep
+     * @return the number of nodes evicted
+     */
+    std::size_t evictSubtrees(
+        const std::shared_ptr<SpillFile> &spillFile,
+        const std::vector<std::pair<util::Vector3I32, util::Vector3I32>> &activeRegions,
+        HashlifeNodeBase::LevelType level);
+    /** read back the evicted subtrees that overlap the box from minPosition to maxPosition
+     * inclusive.
+     * @return the number of subtrees read
+     * @throw io::IOError if a spill file can't be read or doesn't match what was written
+     */
+    std::size_t faultInSubtrees(util::Vector3I32 minPosition, util::Vector3I32 maxPosition);
+    /** the number of stubs for evicted subtrees in this world */
+    std::size_t getEvictedSubtreeCount() const noexcept
+    {
+        return getStubCount(rootNode.get());
+    }
+
+private:
+    struct StubSource final
+    {
+        HashlifeNodeReference<const HashlifeNodeBase, false> stub;
+        /** null if the stub is for a node in mappedWorldFile */
+        std::shared_ptr<SpillFile> spillFile;
+        std::uint64_t fileOffset;
+        std::uint64_t fileSize;
+        std::shared_ptr<MappedWorldFile> mappedWorldFile;
+        std::uint32_t nodeIndex;
+    };
+    HashlifeNodeReference<const HashlifeNodeBase, false> evictNodeSubtrees(
+        const std::shared_ptr<SpillFile> &spillFile,
+        const HashlifeNodeBase *node,
+        util::Vector3I32 nodeMinPosition,
+        const std::vector<std::pair<util::Vector3I32, util::Vector3I32>> &activeRegions,
+        HashlifeNodeBase::LevelType level,
+        std::size_t &evictedCount);
+    /** read the subtree stub at stubMinPosition stands for. Only the parts that overlap the box
+     * from minPosition to endPosition (exclusive) have to be read; the rest can be left as
+     * stubs.
+     */
+    HashlifeNodeReference<const HashlifeNodeBase, false> loadStub(
+        const HashlifeNodeBase *stub,
+        util::Vector3I32 stubMinPosition,
+        util::Vector3<std::int64_t> minPosition,
+        util::Vector3<std::int64_t> endPosition);
+    /** replace the stubs in node that overlap the box from minPosition to endPosition
+     * (exclusive) with the subtrees they stand for */
+    HashlifeNodeReference<const HashlifeNodeBase, false> faultInNode(
+        const HashlifeNodeBase *node,
+        util::Vector3I32 nodeMinPosition,
+        util::Vector3<std::int64_t> minPosition,
+        util::Vector3<std::int64_t> endPosition,
+        std::size_t &faultedInCount);
+    /** faultInNode for all of a snapshot's root */
+    HashlifeNodeReference<const HashlifeNodeBase, false> faultInAll(const HashlifeNodeBase *node)
+    {
+        std::size_t faultedInCount = 0;
+        return faultInNode(node,
+                           util::Vector3I32(-node->getHalfSize()),
+                           util::Vector3<std::int64_t>(-node->getHalfSize()),
+                           util::Vector3<std::int64_t>(node->getHalfSize()),
+                           faultedInCount);
+    }
+    static std::size_t getStubCount(const HashlifeNodeBase *node) noexcept;
+
+public:
+    /** reads blocks from a snapshot, remembering the path from the root to the last block read so
+     * that reading a nearby block only has to descend from their lowest common ancestor.
+     * @note
+     * not thread safe; use one cursor per thread.
+     */
+    class SnapshotCursor final
+    {
+    private:
+        std::shared_ptr<const Snapshot> snapshot;
+        /** path[level] is the node at level that contains lastPosition */
+        util::Array<const HashlifeNodeBase *, HashlifeNodeBase::maxLevel + 1> path;
+        util::Vector3I32 lastPosition;
+        bool hasLastPosition;
+
+    public:
+        explicit SnapshotCursor(std::shared_ptr<const Snapshot> snapshot) noexcept
+            : snapshot(std::move(snapshot)),
+              path(),
+              lastPosition(),
+              hasLastPosition(false)
+        {
+            constexprAssert(this->snapshot);
+            auto rootNode = this->snapshot->rootNode.get();
+            path[rootNode->level] = rootNode;
+        }
+        const std::shared_ptr<const Snapshot> &getSnapshot() const noexcept
+        {
+            return snapshot;
+        }
+        block::Block get(util::Vector3I32 position) noexcept
+        {
+            auto rootNode = snapshot->rootNode.get();
+            if(!rootNode->isPositionInside(position))
+                return block::Block();
+            util::Vector3U32 unsignedPosition(position);
+            auto level = rootNode->level;
+            if(hasLastPosition)
+            {
+                // nodes below the root are aligned to their size, so the lowest common ancestor
+                // is the level of the highest bit that is different between the two positions
+                auto difference = unsignedPosition ^ util::Vector3U32(lastPosition);
+                auto combinedDifference = difference.x | difference.y | difference.z;
+                HashlifeNodeBase::LevelType commonLevel = 0;
+                while(combinedDifference >> 1 >> commonLevel)
+                    commonLevel++;
+                if(commonLevel < level)
+                    level = commonLevel;
+            }
+            lastPosition = position;
+            hasLastPosition = true;
+            const HashlifeNodeBase *node = path[level];
+            for(; level > 0; level--)
+            {
+                util::Vector3U32 index((unsignedPosition.x >> level) & 1,
+                                       (unsignedPosition.y >> level) & 1,
+                                       (unsignedPosition.z >> level) & 1);
+                // the root is centered on the origin, so its child index is inverted
+                if(level == rootNode->level)
+                    index ^= util::Vector3U32(1);
+                node = getAsNonleaf(node)->getChildNode(index).get();
+                path[level - 1] = node;
+            }
+            util::Vector3U32 index(
+                unsignedPosition.x & 1, unsignedPosition.y & 1, unsignedPosition.z & 1);
+            if(rootNode->level == 0)
+                index ^= util::Vector3U32(1);
+            return getAsLeaf(node)->getBlock(index);
+        }
+    };
     class RenderCacheEntryReference final
     {
         friend class HashlifeWorld;
@@ -329,6 +970,11 @@ public:
         {
             return RenderCacheKeyHasher()(key);
         }
+        /** @see RenderCacheKey::getContentHash */
+        std::uint64_t getContentHash() const noexcept
+        {
+            return key.getContentHash();
+        }
         bool operator==(const RenderCacheEntryReference &rt) const noexcept
         {
             return key == rt.key;
@@ -352,12 +998,63 @@ public:
         }
     };
 
+private:
+    struct TransformedNodeKey final
+    {
+        HashlifeNodeReference<const HashlifeNodeBase, false> node;
+        block::BlockTransform blockTransform;
+        bool operator==(const TransformedNodeKey &rt) const noexcept
+        {
+            return node == rt.node && blockTransform == rt.blockTransform;
+        }
+    };
+    struct TransformedNodeKeyHasher final
+    {
+        std::size_t operator()(const TransformedNodeKey &key) const
+        {
+            return std::hash<const HashlifeNodeBase *>()(key.node.get())
+                       * block::BlockTransform::transformCount
+                   + key.blockTransform.getIndex();
+        }
+    };
+    struct NodeGlobalStateKey final
+    {
+        HashlifeNodeReference<const HashlifeNodeBase, false> node;
+        block::BlockStepGlobalState globalState;
+        bool operator==(const NodeGlobalStateKey &rt) const noexcept
+        {
+            return node == rt.node && globalState == rt.globalState;
+        }
+    };
+    struct NodeGlobalStateKeyHasher final
+    {
+        std::size_t operator()(const NodeGlobalStateKey &key) const
+        {
+            return std::hash<const HashlifeNodeBase *>()(key.node.get()) * 8191
+                   + key.globalState.hash();
+        }
+    };
+
 private:
     HashlifeGarbageCollectedHashtable garbageCollectedHashtable;
     std::list<std::weak_ptr<RenderCacheEntryReference>> renderCacheEntryReferences;
     HashlifeNodeReference<const HashlifeNodeBase, false> rootNode;
+    /** where to read the subtree for each stub made by this world from. Entries are removed by
+     * collectGarbage once nothing else uses their stub.
+     */
+    std::unordered_map<const HashlifeNodeBase *, StubSource> stubSources;
     std::unordered_map<RenderCacheKey<false>, RenderCacheEntry, RenderCacheKeyHasher> renderCache;
     std::list<const RenderCacheKey<false> *> renderCacheEntryList;
+    /** memoized results of transformNode; cleared when collecting garbage */
+    std::unordered_map<TransformedNodeKey,
+                       HashlifeNodeReference<const HashlifeNodeBase, false>,
+                       TransformedNodeKeyHasher> transformedNodes;
+    /** nodes at least stillNodeMinimumLevel whose future is their own center without any actions,
+     * so getFilledFutureState doesn't need to recompute them when their future isn't memoized;
+     * cleared when collecting garbage */
+    std::unordered_set<NodeGlobalStateKey, NodeGlobalStateKeyHasher> stillNodes;
+    /** periods found by findPeriod, for every node in the cycle; cleared when collecting garbage */
+    std::unordered_map<NodeGlobalStateKey, std::uint32_t, NodeGlobalStateKeyHasher> periodicNodes;
 #if 0
 #define PROGRAMMERJAKE_VOXELS_WORLD_HASHLIFEWORLD_USE_BLOCKSTEPCACHE
     block::BlockStepCache blockStepCache;
@@ -376,6 +1073,32 @@ public:
             HashlifeNodeReference<const HashlifeNodeBase, true>(rootNode), PrivateAccessTag());
         return retval;
     }
+    /** replace all the blocks in this world with the blocks in snapshot */
+    void restoreSnapshot(const Snapshot &snapshot)
+    {
+        rootNode = HashlifeNodeReference<const HashlifeNodeBase, false>(snapshot.rootNode);
+    }
+    /** @see writeSnapshot
+     * @see writeSnapshotAndMemo
+     */
+    void save(io::OutputStream &os, bool includeMemo = false) const
+    {
+        if(includeMemo)
+            writeSnapshotAndMemo(*makeSnapshot(), os);
+        else
+            writeSnapshot(*makeSnapshot(), os);
+    }
+    /** @see readSnapshot */
+    void load(io::InputStream &is)
+    {
+        restoreSnapshot(*readSnapshot(is));
+    }
+    /** the number of nodes in memory, including ones that aren't used anymore but haven't been
+     * garbage collected yet */
+    std::size_t getNodeCount() const noexcept
+    {
+        return garbageCollectedHashtable.getNodeCount();
+    }
     bool isSame(const std::shared_ptr<const Snapshot> &snapshot) const noexcept
     {
         return snapshot->rootNode == rootNode;
@@ -388,13 +1111,126 @@ public:
     {
         return getBlock(rootNode.get(), position);
     }
+    /** @see Snapshot::castRay */
+    util::Optional<RayCastHit> castRay(const util::ray_casting::Ray &ray, float maxT) const
+    {
+        return castRayImplementation(rootNode.get(), ray, maxT);
+    }
+    /** @see Snapshot::castRays */
+    std::vector<util::Optional<RayCastHit>> castRays(
+        const std::vector<util::ray_casting::Ray> &rays, float maxT) const
+    {
+        return castRaysImplementation(rootNode.get(), rays, maxT);
+    }
+    /** @see Snapshot::findCollidingBlocks */
+    void findCollidingBlocks(
+        util::Vector3F boxMinPosition,
+        util::Vector3F boxMaxPosition,
+        util::ray_casting::BlockCollisionMask collisionMask,
+        util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn) const
+    {
+        findCollidingBlocksImplementation(
+            rootNode.get(), boxMinPosition, boxMaxPosition, collisionMask, fn);
+    }
+    /** @see Snapshot::findBlocks */
+    void findBlocks(
+        block::BlockKind blockKind,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition,
+        util::FunctionReference<void(util::Vector3I32 position, block::Block block)> fn) const
+    {
+        findBlocksImplementation(rootNode.get(), blockKind, minPosition, maxPosition, fn);
+    }
+    /** @see Snapshot::getBlockKindCounts */
+    HashlifeBlockKindCounts getBlockKindCounts(util::Vector3I32 minPosition,
+                                               util::Vector3I32 maxPosition) const
+    {
+        return getBlockKindCountsImplementation(rootNode.get(), minPosition, maxPosition);
+    }
+    /** @see Snapshot::countBlocks */
+    HashlifeBlockKindCounts::CountType countBlocks(
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition,
+        util::FunctionReference<bool(block::BlockKind blockKind)> predicate) const
+    {
+        return countBlocksImplementation(rootNode.get(), minPosition, maxPosition, predicate);
+    }
+    /** @see Snapshot::sweepBox */
+    util::Optional<SweptBoxHit> sweepBox(util::Vector3F boxMinPosition,
+                                         util::Vector3F boxMaxPosition,
+                                         util::Vector3F displacement,
+                                         util::ray_casting::BlockCollisionMask collisionMask) const
+    {
+        return sweepBoxImplementation(
+            rootNode.get(), boxMinPosition, boxMaxPosition, displacement, collisionMask);
+    }
 
 private:
+    /** make a node one level bigger with node in the center and empty blocks around it */
+    HashlifeNodeReference<const HashlifeNodeBase, false> getExpandedNode(
+        const HashlifeNodeBase *node);
     void expandRoot();
+    /** replace the blocks outside of [minPosition, endPosition) with empty blocks */
+    HashlifeNodeReference<const HashlifeNodeBase, false> cropNode(
+        const HashlifeNodeBase *node,
+        util::Vector3I32 nodeMinPosition,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 endPosition);
+    /** get the node one level smaller covering the center of node */
+    HashlifeNodeReference<const HashlifeNodeBase, false> getCenterNode(
+        const HashlifeNodeBase *node);
+    /** step node once without letting it grow, returning null if any blocks would change outside
+     * of node */
+    HashlifeNodeReference<const HashlifeNodeBase, false> stepIsolatedNode(
+        const HashlifeNodeBase *node, const block::BlockStepGlobalState &stepGlobalState);
     const HashlifeNonleafNode::FutureState &getFilledFutureState(
         const HashlifeNodeBase *nodeIn, const block::BlockStepGlobalState &stepGlobalState);
 
 public:
+    /** the smallest level that getFilledFutureState records still nodes at; smaller nodes are
+     * cheap enough to recompute */
+    static constexpr HashlifeNodeBase::LevelType stillNodeMinimumLevel = 3;
+    /** the smallest level that stepIsolatedNode works at: the shell around the center must be at
+     * least as wide as the distance blocks can travel in one step */
+    static constexpr HashlifeNodeBase::LevelType isolatedNodeMinimumLevel = 5;
+    struct PeriodStatistics final
+    {
+        /** the number of (node, global state) pairs whose future is their own center */
+        std::size_t stillNodeCount = 0;
+        /** the number of (node, global state) pairs findPeriod found with a period of 1 */
+        std::size_t stillSnapshotCount = 0;
+        /** the number of (node, global state) pairs findPeriod found with a period more than 1 */
+        std::size_t oscillatingSnapshotCount = 0;
+    };
+    PeriodStatistics getPeriodStatistics() const noexcept
+    {
+        PeriodStatistics retval;
+        retval.stillNodeCount = stillNodes.size();
+        for(auto &periodicNode : periodicNodes)
+        {
+            if(periodicNode.second == 1)
+                retval.stillSnapshotCount++;
+            else
+                retval.oscillatingSnapshotCount++;
+        }
+        return retval;
+    }
+    /** find the number of steps after which the blocks in snapshot repeat, when nothing outside of
+     * snapshot's root affects them and stepGlobalState is used for every step.
+     * The BlockStepExtraActions aren't run, so changes they would make aren't considered.
+     * @param snapshot must be from this world
+     * @return the period, or nothing if it isn't found within maxPeriod steps or any blocks change
+     * outside of snapshot's root */
+    util::Optional<std::uint32_t> findPeriod(const Snapshot &snapshot,
+                                             std::uint32_t maxPeriod,
+                                             const block::BlockStepGlobalState &stepGlobalState);
+    /** step snapshot stepCount times using findPeriod to skip whole periods.
+     * The BlockStepExtraActions aren't run.
+     * @param snapshot must be from this world */
+    std::shared_ptr<const Snapshot> fastForward(const Snapshot &snapshot,
+                                                std::uint64_t stepCount,
+                                                const block::BlockStepGlobalState &stepGlobalState,
+                                                std::uint32_t maxPeriod);
     block::BlockStepExtraActions stepAndCollectGarbage(
         const block::BlockStepGlobalState &stepGlobalState,
         std::size_t garbageCollectTargetNodeCount =
@@ -404,8 +1240,34 @@ public:
         collectGarbage(garbageCollectTargetNodeCount, renderCacheTargetEntryCount);
         return step(stepGlobalState);
     }
+    /** predict what the blocks from minPosition to maxPosition inclusive will be after running
+     * step once for each element of stepGlobalStates, starting from snapshot.
+     * Only the blocks that can affect the region in that many steps are stepped, and the memoized
+     * futures are shared with step. The BlockStepExtraActions are not run, so changes they would
+     * make aren't predicted.
+     * @param snapshot must be from this world
+     * @return a snapshot that has the predicted blocks in the region; the blocks outside of the
+     * region are unspecified.
+     */
+    std::shared_ptr<const Snapshot> predictRegion(
+        const Snapshot &snapshot,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 maxPosition,
+        const std::vector<block::BlockStepGlobalState> &stepGlobalStates);
+    /** @see predictRegion */
+    block::Block predictBlock(const Snapshot &snapshot,
+                              util::Vector3I32 position,
+                              const std::vector<block::BlockStepGlobalState> &stepGlobalStates)
+    {
+        return predictRegion(snapshot, position, position, stepGlobalStates)->get(position);
+    }
+    /** step the world once. Evicted subtrees are faulted back in first, since every block is
+     * stepped.
+     */
     block::BlockStepExtraActions step(const block::BlockStepGlobalState &stepGlobalState)
     {
+        if(rootNode->hasStubs)
+            faultInSubtrees(minPosition(), maxPosition());
         do
         {
             expandRoot();
@@ -416,7 +1278,9 @@ public:
         constexprAssert(futureState.globalState == stepGlobalState);
         rootNode = futureState.node;
         block::BlockStepExtraActions actions;
-        for(auto &i : futureState.actions)
+        if(!futureState.actions)
+            return actions;
+        for(auto &i : *futureState.actions)
         {
             for(auto &j : i)
             {
@@ -528,6 +1392,7 @@ public:
         while(!rootNode->isPositionInside(worldPosition)
               || !rootNode->isPositionInside(worldPosition + size - util::Vector3I32(1)))
             expandRoot();
+        faultInSubtrees(worldPosition, worldPosition + size - util::Vector3I32(1));
         rootNode = setBlocks(rootNode.get(),
                              std::forward<BlocksArray>(blocksArray),
                              worldPosition,
@@ -609,6 +1474,46 @@ private:
             }
         }
     }
+    /** a dense x-major array of blocks, used for the fast path of getBlocks */
+    struct ContiguousBlocksArray final
+    {
+        block::Block *blocks;
+        util::Vector3I32 arraySize;
+        ContiguousBlocksArray(block::Block *blocks, util::Vector3I32 arraySize) noexcept
+            : blocks(blocks),
+              arraySize(arraySize)
+        {
+        }
+        block::Block *getRow(std::int32_t x, std::int32_t y) const noexcept
+        {
+            return blocks + (static_cast<std::size_t>(x) * arraySize.y + y) * arraySize.z;
+        }
+    };
+    /** fills uniform nodes with std::fill and copies leaves directly instead of going through
+     * the generic indexers
+     */
+    static void getBlocksImplementation(const HashlifeNodeBase *node,
+                                        ContiguousBlocksArray blocksArray,
+                                        util::Vector3I32 worldPosition,
+                                        util::Vector3I32 arrayPosition,
+                                        util::Vector3I32 size);
+    template <std::size_t SizeX, std::size_t SizeY, std::size_t SizeZ>
+    static void getBlocksImplementation(
+        const HashlifeNodeBase *node,
+        util::Array<util::Array<util::Array<block::Block, SizeZ>, SizeY>, SizeX> &blocksArray,
+        util::Vector3I32 worldPosition,
+        util::Vector3I32 arrayPosition,
+        util::Vector3I32 size)
+    {
+        static_assert(sizeof(blocksArray) == sizeof(block::Block) * SizeX * SizeY * SizeZ,
+                      "util::Array must be contiguous");
+        getBlocksImplementation(node,
+                                ContiguousBlocksArray(&blocksArray[0][0][0],
+                                                      util::Vector3I32(SizeX, SizeY, SizeZ)),
+                                worldPosition,
+                                arrayPosition,
+                                size);
+    }
     template <typename BlocksArray>
     static void getBlocks(const HashlifeNodeBase *node,
                           BlocksArray &&blocksArray,
@@ -674,6 +1579,79 @@ public:
         blocks[0][0][0] = block;
         setBlocks(blocks, position, util::Vector3I32(0), util::Vector3I32(1));
     }
+    typedef std::pair<util::Vector3I32, block::Block> BlockEdit;
+
+private:
+    HashlifeNodeReference<const HashlifeNodeBase, false> applyEdits(const HashlifeNodeBase *node,
+                                                                    util::Vector3I32 nodeCenter,
+                                                                    const BlockEdit *editsBegin,
+                                                                    const BlockEdit *editsEnd);
+
+public:
+    /** set many scattered blocks at once.
+     * the edits are sorted into octree order so each modified node is rebuilt only once.
+     * if there are multiple edits to the same position, the last one wins.
+     */
+    void applyEdits(std::vector<BlockEdit> edits);
+
+private:
+    struct FillRegionMemo;
+    HashlifeNodeReference<const HashlifeNodeBase, false> fillRegion(const HashlifeNodeBase *node,
+                                                                    util::Vector3I32 minPosition,
+                                                                    util::Vector3I32 endPosition,
+                                                                    block::Block block,
+                                                                    FillRegionMemo &memo);
+    HashlifeNodeReference<const HashlifeNodeBase, false> fillRegionImplementation(
+        const HashlifeNodeBase *node,
+        util::Vector3I32 minPosition,
+        util::Vector3I32 endPosition,
+        block::Block block,
+        FillRegionMemo &memo);
+
+public:
+    /** fill the box from minPosition to maxPosition (inclusive) with block.
+     * subtrees that are entirely inside the box are replaced with canonical uniform nodes, so only
+     * the boundary of the box is visited, and repeated boundary nodes are only rebuilt once.
+     */
+    void fillRegion(util::Vector3I32 minPosition, util::Vector3I32 maxPosition, block::Block block);
+
+private:
+    /** rotate and/or mirror node about its center */
+    HashlifeNodeReference<const HashlifeNodeBase, false> transformNode(
+        const HashlifeNodeBase *node, block::BlockTransform blockTransform);
+    struct CopyRegionState;
+    HashlifeNodeReference<const HashlifeNodeBase, false> getCopyRegionSourceNode(
+        CopyRegionState &state, HashlifeNodeBase::LevelType level, util::Vector3I32 minPosition);
+    HashlifeNodeReference<const HashlifeNodeBase, false> shiftNodes(
+        CopyRegionState &state,
+        const HashlifeNonleafNode::ChildNodesArray &nodes,
+        util::Vector3I32 offset);
+    HashlifeNodeReference<const HashlifeNodeBase, false> copyRegion(const HashlifeNodeBase *node,
+                                                                    util::Vector3I32 nodeCenter,
+                                                                    util::Vector3I32 minPosition,
+                                                                    util::Vector3I32 endPosition,
+                                                                    CopyRegionState &state);
+
+public:
+    /** copy the box from sourceMinPosition to sourceMaxPosition (inclusive) to the box starting
+     * at destinationMinPosition.
+     * the overlapping source and destination boxes are handled as if the source was copied first.
+     * nodes that end up at the same alignment are reused directly, and misaligned nodes are
+     * re-tiled from the source nodes with memoization, so the cost scales with the surface area
+     * of the box rather than its volume.
+     */
+    void copyRegion(util::Vector3I32 sourceMinPosition,
+                    util::Vector3I32 sourceMaxPosition,
+                    util::Vector3I32 destinationMinPosition);
+    /** copy the box from sourceMinPosition to sourceMaxPosition (inclusive) rotated and/or
+     * mirrored by blockTransform to the box starting at destinationMinPosition.
+     * transformed nodes are memoized, so transforming repeated structures is nearly free.
+     * @see copyRegion
+     */
+    void transformRegion(util::Vector3I32 sourceMinPosition,
+                         util::Vector3I32 sourceMaxPosition,
+                         block::BlockTransform blockTransform,
+                         util::Vector3I32 destinationMinPosition);
     util::Vector3I32 minPosition() const noexcept
     {
         return util::Vector3I32(-rootNode->getHalfSize());
@@ -728,6 +1706,8 @@ public:
         {
             expandRoot();
         }
+        faultInSubtrees(position - util::Vector3I32(renderCacheCenterSize),
+                        position + util::Vector3I32(2 * renderCacheCenterSize - 1));
         RenderCacheKey<false> key(blockStepGlobalState);
         for(std::size_t x = 0; x < renderCacheNodeArraySize; x++)
         {
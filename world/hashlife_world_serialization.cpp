@@ -0,0 +1,1338 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "hashlife_world.h"
+#include "../util/constexpr_assert.h"
+#include "../io/lz_stream.h"
+#include "../io/memory_stream.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+#include <system_error>
+#include <limits>
+#include <algorithm>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace world
+{
+/* world file format, all integers are little endian:
+ * u32 magic ("VXHL")
+ * u32 version
+ * u32 flags: worldFileCompressedFlag if everything after the flags is compressed by
+ * io::LZCompressingOutputStream, and worldFileMemoFlag if there is a memo section
+ * var block kind count, not counting the empty block kind which is always index 0
+ * for each block kind:
+ *     var name length
+ *     name bytes
+ * var palette size
+ * for each palette entry, the most common first:
+ *     var block: the lighting bits are unchanged and the block kind is the index into the block
+ *     kind table
+ * var node count
+ * for each node, children before their parents:
+ *     u8 level
+ *     if level is 0:
+ *         8 var palette indexes
+ *     else:
+ *         8 var differences between this node's index and the child's index
+ * if there is no memo section, the last node is the root
+ * memo section:
+ *     var root node index
+ *     u64 block::BlockDescriptor::getStepFingerprint() of the code that computed the futures;
+ *     the futures are ignored if it doesn't match
+ *     var global state count
+ *     for each global state:
+ *         var dimension name length
+ *         dimension name bytes
+ *         u8 skylight
+ *     var memo count
+ *     for each memoized future:
+ *         var index of a nonleaf node
+ *         var global state index
+ *         var index of the node's future, one level smaller
+ * the blocks and children are in x-major, then y, then z order
+ * var is an unsigned LEB128 variable length integer
+ */
+/* mapped world file format, all integers are little endian:
+ * u32 magic ("VXHM")
+ * u32 version
+ * u32 level count: the root level plus one
+ * u32 block kind count, not counting the empty block kind which is always index 0
+ * u32 node count
+ * u32 file offset of the node records, a multiple of 8
+ * for each level from 0 to the root level:
+ *     u32 index of the first node at this level
+ *     u32 number of nodes at this level
+ * for each block kind:
+ *     u32 name length
+ *     name bytes
+ * zero padding up to the node records
+ * for each node, sorted by level:
+ *     8 u32 blocks like the world file format if the level is 0, otherwise 8 u32 indexes of
+ *     nodes from the level below
+ *     u64 content hash
+ * the last node is the root and is the only node at its level
+ */
+/* append log format, all integers are little endian:
+ * u32 magic ("VXHA")
+ * u32 version
+ * records, each starting with a u8 record type:
+ *     block kind: u32 name length, name bytes. Block kinds are numbered from 1 in the order
+ *     they are written; 0 is the empty block kind.
+ *     leaf node: 8 u32 blocks like the world file format
+ *     nonleaf node: u8 level, 8 u32 indexes of previously written nodes
+ *     root: u32 index of the node that is the root from now on
+ * nodes are numbered from 0 in the order they are written
+ */
+namespace
+{
+constexpr std::uint32_t worldFileMagic = 0x4C485856UL; // "VXHL"
+constexpr std::uint32_t worldFileVersion = 1;
+constexpr std::uint32_t worldFileCompressedFlag = 0x1;
+constexpr std::uint32_t worldFileMemoFlag = 0x2;
+constexpr std::uint32_t mappedWorldFileMagic = 0x4D485856UL; // "VXHM"
+constexpr std::uint32_t mappedWorldFileVersion = 1;
+constexpr std::size_t mappedWorldFileHeaderSize = 24;
+constexpr std::uint32_t appendLogMagic = 0x41485856UL; // "VXHA"
+constexpr std::uint32_t appendLogVersion = 1;
+enum class AppendLogRecordType : std::uint8_t
+{
+    BlockKind = 0,
+    LeafNode = 1,
+    NonleafNode = 2,
+    Root = 3,
+};
+
+io::IOError makeInvalidWorldFileError(const char *message)
+{
+    return io::IOError(std::make_error_code(std::errc::illegal_byte_sequence),
+                       std::string("invalid world file: ") + message);
+}
+
+/** the longest block kind or dimension name read, so a bad length can't allocate much */
+constexpr std::uint32_t maximumNameLength = 1024;
+
+std::string readName(io::InputStream &is, std::uint32_t nameLength)
+{
+    if(nameLength > maximumNameLength)
+        throw makeInvalidWorldFileError("name too long");
+    std::string retval;
+    retval.resize(nameLength);
+    is.readAllBytes(reinterpret_cast<unsigned char *>(&retval[0]), retval.size());
+    return retval;
+}
+
+/** @throw io::IOError if snapshot has evicted subtrees, since their blocks aren't in memory */
+void checkNoEvictedSubtrees(const HashlifeWorld::Snapshot &snapshot)
+{
+    if(snapshot.hasEvictedSubtrees())
+        throw io::IOError(std::make_error_code(std::errc::operation_not_permitted),
+                          "can't save a snapshot with evicted subtrees; fault them in first");
+}
+
+constexpr block::Block::ValueType blockKindShift = lighting::Lighting::lightBitWidth * 3;
+constexpr block::Block::ValueType blockLightingMask = (1UL << blockKindShift) - 1;
+
+struct SnapshotWriter final
+{
+    /** the nodes in the order they are written */
+    std::vector<const HashlifeNodeBase *> nodes;
+    std::unordered_map<const HashlifeNodeBase *, std::uint32_t> nodeIndexes;
+    std::vector<const block::BlockDescriptor *> blockDescriptors;
+    std::unordered_map<block::BlockKind::ValueType, std::uint32_t> blockKindIndexes;
+    /** the nodes with futures to write in the memo section */
+    std::vector<const HashlifeNonleafNode *> memoizedNodes;
+    std::vector<block::BlockStepGlobalState> globalStates;
+    std::unordered_map<block::BlockStepGlobalState, std::uint32_t> globalStateIndexes;
+    const HashlifeNodeBase *rootNode = nullptr;
+    void addNode(const HashlifeNodeBase *node)
+    {
+        if(nodeIndexes.count(node))
+            return;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    if(node->isLeaf())
+                        addBlockKind(getAsLeaf(node)->getBlock(position).getBlockKind());
+                    else
+                        addNode(getAsNonleaf(node)->getChildNode(position).get());
+                }
+            }
+        }
+        if(nodes.size() >= std::numeric_limits<std::uint32_t>::max())
+            throw io::IOError(std::make_error_code(std::errc::file_too_large),
+                              "too many nodes to write world file");
+        nodeIndexes.emplace(node, nodes.size());
+        nodes.push_back(node);
+    }
+    void addRootNode(const HashlifeNodeBase *node)
+    {
+        addNode(node);
+        rootNode = node;
+    }
+    /** add node and its future if it is memoized.
+     * futures with extra actions aren't written since the actions can't be saved, they are
+     * recomputed instead.
+     */
+    void addMemo(const HashlifeNodeBase *node)
+    {
+        if(node->isLeaf())
+            return;
+        auto &futureState = getAsNonleaf(node)->futureState;
+        if(!futureState.node || futureState.actions)
+            return;
+        addNode(node);
+        addNode(futureState.node.get());
+        if(!globalStateIndexes.count(futureState.globalState))
+        {
+            globalStateIndexes.emplace(futureState.globalState, globalStates.size());
+            globalStates.push_back(futureState.globalState);
+        }
+        memoizedNodes.push_back(getAsNonleaf(node));
+    }
+    void addBlockKind(block::BlockKind blockKind)
+    {
+        if(blockKind == block::BlockKind::empty() || blockKindIndexes.count(blockKind.value))
+            return;
+        blockDescriptors.push_back(block::BlockDescriptor::get(blockKind));
+        blockKindIndexes.emplace(blockKind.value, blockDescriptors.size());
+    }
+    block::Block::ValueType getBlockValue(block::Block block) const
+    {
+        block::Block::ValueType blockKindIndex = 0;
+        if(block.getBlockKind() != block::BlockKind::empty())
+            blockKindIndex = blockKindIndexes.at(block.getBlockKind().value);
+        return (block.value & blockLightingMask) | (blockKindIndex << blockKindShift);
+    }
+    void write(io::OutputStream &os, bool useCompression) const
+    {
+        os.writeU32(worldFileMagic);
+        os.writeU32(worldFileVersion);
+        std::uint32_t flags = 0;
+        if(useCompression)
+            flags |= worldFileCompressedFlag;
+        if(!memoizedNodes.empty())
+            flags |= worldFileMemoFlag;
+        os.writeU32(flags);
+        if(useCompression)
+        {
+            io::LZCompressingOutputStream compressingOutputStream(os);
+            writeBody(compressingOutputStream);
+            compressingOutputStream.finish();
+        }
+        else
+        {
+            writeBody(os);
+        }
+    }
+    void writeBody(io::OutputStream &os) const
+    {
+        os.writeVarU32(blockDescriptors.size());
+        for(auto blockDescriptor : blockDescriptors)
+        {
+            os.writeVarU32(blockDescriptor->name.size());
+            os.writeBytes(reinterpret_cast<const unsigned char *>(blockDescriptor->name.data()),
+                          blockDescriptor->name.size());
+        }
+        std::unordered_map<block::Block::ValueType, std::size_t> blockValueCounts;
+        for(auto node : nodes)
+        {
+            if(!node->isLeaf())
+                continue;
+            for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize;
+                position.x++)
+            {
+                for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+                {
+                    for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                    {
+                        blockValueCounts[getBlockValue(getAsLeaf(node)->getBlock(position))]++;
+                    }
+                }
+            }
+        }
+        std::vector<std::pair<block::Block::ValueType, std::size_t>> palette(
+            blockValueCounts.begin(), blockValueCounts.end());
+        std::sort(palette.begin(),
+                  palette.end(),
+                  [](const std::pair<block::Block::ValueType, std::size_t> &a,
+                     const std::pair<block::Block::ValueType, std::size_t> &b)
+                  {
+                      if(std::get<1>(a) != std::get<1>(b))
+                          return std::get<1>(a) > std::get<1>(b);
+                      return std::get<0>(a) < std::get<0>(b);
+                  });
+        std::unordered_map<block::Block::ValueType, std::uint32_t> paletteIndexes;
+        os.writeVarU32(palette.size());
+        for(auto &paletteEntry : palette)
+        {
+            paletteIndexes.emplace(std::get<0>(paletteEntry), paletteIndexes.size());
+            os.writeVarU32(std::get<0>(paletteEntry));
+        }
+        os.writeVarU32(nodes.size());
+        for(std::uint32_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+        {
+            auto node = nodes[nodeIndex];
+            os.writeU8(node->level);
+            for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize;
+                position.x++)
+            {
+                for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+                {
+                    for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                    {
+                        if(node->isLeaf())
+                            os.writeVarU32(paletteIndexes.at(
+                                getBlockValue(getAsLeaf(node)->getBlock(position))));
+                        else
+                            os.writeVarU32(nodeIndex
+                                           - nodeIndexes.at(
+                                                 getAsNonleaf(node)->getChildNode(position).get()));
+                    }
+                }
+            }
+        }
+        if(!memoizedNodes.empty())
+            writeMemo(os);
+    }
+    void writeMemo(io::OutputStream &os) const
+    {
+        os.writeVarU32(nodeIndexes.at(rootNode));
+        os.writeU64(block::BlockDescriptor::getStepFingerprint());
+        os.writeVarU32(globalStates.size());
+        for(auto &globalState : globalStates)
+        {
+            auto &dimensionName = globalState.getDimension().getName();
+            os.writeVarU32(dimensionName.size());
+            os.writeBytes(reinterpret_cast<const unsigned char *>(dimensionName.data()),
+                          dimensionName.size());
+            os.writeU8(globalState.lightingGlobalProperties.skylight);
+        }
+        os.writeVarU32(memoizedNodes.size());
+        for(auto node : memoizedNodes)
+        {
+            os.writeVarU32(nodeIndexes.at(node));
+            os.writeVarU32(globalStateIndexes.at(node->futureState.globalState));
+            os.writeVarU32(nodeIndexes.at(node->futureState.node.get()));
+        }
+    }
+};
+
+struct MappedSnapshotWriter final
+{
+    SnapshotWriter snapshotWriter;
+    /** the nodes in the order they are written */
+    std::vector<const HashlifeNodeBase *> nodes;
+    std::unordered_map<const HashlifeNodeBase *, std::uint32_t> nodeIndexes;
+    std::vector<std::uint32_t> levelNodeCounts;
+    explicit MappedSnapshotWriter(const HashlifeNodeBase *rootNode)
+    {
+        snapshotWriter.addNode(rootNode);
+        levelNodeCounts.resize(rootNode->level + 1);
+        for(auto node : snapshotWriter.nodes)
+            levelNodeCounts[node->level]++;
+        std::vector<std::vector<const HashlifeNodeBase *>> levels(levelNodeCounts.size());
+        for(auto node : snapshotWriter.nodes)
+            levels[node->level].push_back(node);
+        nodes.reserve(snapshotWriter.nodes.size());
+        for(auto &level : levels)
+        {
+            for(auto node : level)
+            {
+                nodeIndexes.emplace(node, nodes.size());
+                nodes.push_back(node);
+            }
+        }
+    }
+    void write(io::OutputStream &os) const
+    {
+        std::size_t headerSize =
+            mappedWorldFileHeaderSize + levelNodeCounts.size() * 2 * sizeof(std::uint32_t);
+        for(auto blockDescriptor : snapshotWriter.blockDescriptors)
+            headerSize += sizeof(std::uint32_t) + blockDescriptor->name.size();
+        std::size_t paddingSize = (8 - headerSize % 8) % 8;
+        os.writeU32(mappedWorldFileMagic);
+        os.writeU32(mappedWorldFileVersion);
+        os.writeU32(levelNodeCounts.size());
+        os.writeU32(snapshotWriter.blockDescriptors.size());
+        os.writeU32(nodes.size());
+        os.writeU32(headerSize + paddingSize);
+        std::uint32_t firstNodeIndex = 0;
+        for(auto levelNodeCount : levelNodeCounts)
+        {
+            os.writeU32(firstNodeIndex);
+            os.writeU32(levelNodeCount);
+            firstNodeIndex += levelNodeCount;
+        }
+        for(auto blockDescriptor : snapshotWriter.blockDescriptors)
+        {
+            os.writeU32(blockDescriptor->name.size());
+            os.writeBytes(reinterpret_cast<const unsigned char *>(blockDescriptor->name.data()),
+                          blockDescriptor->name.size());
+        }
+        for(std::size_t i = 0; i < paddingSize; i++)
+            os.writeU8(0);
+        for(std::size_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+        {
+            auto node = nodes[nodeIndex];
+            for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize;
+                position.x++)
+            {
+                for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+                {
+                    for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                    {
+                        if(node->isLeaf())
+                            os.writeU32(snapshotWriter.getBlockValue(
+                                getAsLeaf(node)->getBlock(position)));
+                        else
+                            os.writeU32(nodeIndexes.at(
+                                getAsNonleaf(node)->getChildNode(position).get()));
+                    }
+                }
+            }
+            os.writeU64(node->contentHash);
+        }
+    }
+};
+}
+
+void HashlifeWorld::writeSnapshot(const Snapshot &snapshot,
+                                  io::OutputStream &os,
+                                  bool useCompression)
+{
+    checkNoEvictedSubtrees(snapshot);
+    SnapshotWriter writer;
+    writer.addRootNode(snapshot.rootNode.get());
+    writer.write(os, useCompression);
+}
+
+void HashlifeWorld::writeSnapshotAndMemo(const Snapshot &snapshot,
+                                         io::OutputStream &os,
+                                         bool useCompression) const
+{
+    checkNoEvictedSubtrees(snapshot);
+    SnapshotWriter writer;
+    writer.addRootNode(snapshot.rootNode.get());
+    garbageCollectedHashtable.forEachNode([&](const HashlifeNodeBase *node)
+                                          {
+                                              writer.addMemo(node);
+                                          });
+    writer.write(os, useCompression);
+}
+
+namespace
+{
+struct SnapshotReader final
+{
+    io::InputStream &is;
+    std::vector<block::BlockKind> blockKinds;
+    std::vector<block::Block> palette;
+    struct MemoEntry final
+    {
+        const HashlifeNonleafNode *node;
+        std::uint32_t globalStateIndex;
+        const HashlifeNodeBase *futureNode;
+    };
+    std::vector<block::BlockStepGlobalState> memoGlobalStates;
+    /** the memoized futures read by readMemo, which are only applied once the whole file is read */
+    std::vector<MemoEntry> memoEntries;
+    explicit SnapshotReader(io::InputStream &is)
+        : is(is), blockKinds(), palette(), memoGlobalStates(), memoEntries()
+    {
+    }
+    block::Block readBlockValue()
+    {
+        auto value = is.readVarU32();
+        auto blockKindIndex = value >> blockKindShift;
+        if(blockKindIndex >= blockKinds.size())
+            throw makeInvalidWorldFileError("block kind index out of range");
+        return block::Block(
+            (value & blockLightingMask)
+            | (static_cast<block::Block::ValueType>(blockKinds[blockKindIndex].value)
+               << blockKindShift));
+    }
+    block::Block readBlock()
+    {
+        auto paletteIndex = is.readVarU32();
+        if(paletteIndex >= palette.size())
+            throw makeInvalidWorldFileError("palette index out of range");
+        return palette[paletteIndex];
+    }
+    std::uint32_t readChildNodeIndex(std::uint32_t nodeIndex)
+    {
+        auto value = is.readVarU32();
+        if(value == 0 || value > nodeIndex)
+            throw makeInvalidWorldFileError("node index out of range");
+        return nodeIndex - value;
+    }
+    void readHeader()
+    {
+        blockKinds.push_back(block::BlockKind::empty());
+        std::uint32_t blockKindCount = is.readVarU32();
+        if(blockKindCount >= (1UL << block::Block::blockKindValueBitWidth))
+            throw makeInvalidWorldFileError("too many block kinds");
+        for(std::uint32_t i = 0; i < blockKindCount; i++)
+        {
+            auto name = readName(is, is.readVarU32());
+            auto blockDescriptor = block::BlockDescriptor::getByName(name);
+            if(!blockDescriptor)
+                throw makeInvalidWorldFileError("unknown block kind");
+            blockKinds.push_back(blockDescriptor->blockKind);
+        }
+        std::uint32_t paletteSize = is.readVarU32();
+        for(std::uint32_t i = 0; i < paletteSize; i++)
+            palette.push_back(readBlockValue());
+    }
+    const HashlifeNodeBase *readNodeIndex(
+        const std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> &nodes)
+    {
+        auto nodeIndex = is.readVarU32();
+        if(nodeIndex >= nodes.size())
+            throw makeInvalidWorldFileError("node index out of range");
+        return nodes[nodeIndex].get();
+    }
+    /** read the memo section into memoEntries, leaving it empty if the futures were computed by
+     * different block step functions
+     * @return the root node
+     */
+    const HashlifeNodeBase *readMemo(
+        const std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> &nodes)
+    {
+        auto rootNode = readNodeIndex(nodes);
+        bool isStepFingerprintMatched =
+            is.readU64() == block::BlockDescriptor::getStepFingerprint();
+        std::uint32_t globalStateCount = is.readVarU32();
+        for(std::uint32_t i = 0; i < globalStateCount; i++)
+        {
+            auto dimensionName = readName(is, is.readVarU32());
+            auto dimension = Dimension::getByName(dimensionName);
+            if(!dimension)
+                throw makeInvalidWorldFileError("unknown dimension");
+            auto skylight = is.readU8();
+            if(skylight > lighting::Lighting::maxLight)
+                throw makeInvalidWorldFileError("skylight out of range");
+            memoGlobalStates.push_back(block::BlockStepGlobalState(
+                lighting::Lighting::GlobalProperties(skylight, *dimension)));
+        }
+        std::uint32_t memoCount = is.readVarU32();
+        for(std::uint32_t i = 0; i < memoCount; i++)
+        {
+            auto node = readNodeIndex(nodes);
+            auto globalStateIndex = is.readVarU32();
+            if(globalStateIndex >= memoGlobalStates.size())
+                throw makeInvalidWorldFileError("global state index out of range");
+            auto futureNode = readNodeIndex(nodes);
+            if(node->isLeaf() || futureNode->level != node->level - 1)
+                throw makeInvalidWorldFileError("memoized future has wrong level");
+            if(isStepFingerprintMatched)
+                memoEntries.push_back(MemoEntry{getAsNonleaf(node), globalStateIndex, futureNode});
+        }
+        return rootNode;
+    }
+    /** restore the memoized futures read by readMemo */
+    void applyMemo()
+    {
+        for(auto &memoEntry : memoEntries)
+        {
+            auto &futureState = memoEntry.node->futureState;
+            if(futureState.node)
+                continue; // already computed in this world
+            futureState =
+                HashlifeNonleafNode::FutureState(memoGlobalStates[memoEntry.globalStateIndex]);
+            futureState.node = memoEntry.futureNode->referenceFromThis<false>();
+        }
+    }
+};
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::readSnapshot(io::InputStream &is)
+{
+    if(is.readU32() != worldFileMagic)
+        throw makeInvalidWorldFileError("bad magic number");
+    if(is.readU32() != worldFileVersion)
+        throw makeInvalidWorldFileError("unsupported version");
+    std::uint32_t flags = is.readU32();
+    if(flags & ~(worldFileCompressedFlag | worldFileMemoFlag))
+        throw makeInvalidWorldFileError("unknown flags");
+    if(flags & worldFileCompressedFlag)
+    {
+        io::LZDecompressingInputStream decompressingInputStream(is);
+        return readSnapshotBody(decompressingInputStream, flags);
+    }
+    return readSnapshotBody(is, flags);
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::readSnapshotBody(
+    io::InputStream &is, std::uint32_t flags)
+{
+    SnapshotReader reader(is);
+    reader.readHeader();
+    std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> nodes;
+    std::uint32_t nodeCount = is.readVarU32();
+    if(nodeCount == 0)
+        throw makeInvalidWorldFileError("no root node");
+    for(std::uint32_t nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+    {
+        HashlifeNodeBase::LevelType level = is.readU8();
+        if(level > HashlifeNodeBase::maxLevel)
+            throw makeInvalidWorldFileError("node level too big");
+        if(HashlifeNodeBase::isLeaf(level))
+        {
+            HashlifeLeafNode::BlocksArray blocks;
+            for(auto &i : blocks)
+            {
+                for(auto &j : i)
+                {
+                    for(auto &block : j)
+                    {
+                        block = reader.readBlock();
+                    }
+                }
+            }
+            nodes.push_back(garbageCollectedHashtable.findOrAddNode(std::move(blocks)));
+        }
+        else
+        {
+            HashlifeNonleafNode::ChildNodesArray childNodes;
+            for(auto &i : childNodes)
+            {
+                for(auto &j : i)
+                {
+                    for(auto &childNode : j)
+                    {
+                        auto childNodeIndex = reader.readChildNodeIndex(nodeIndex);
+                        if(childNodeIndex >= nodes.size())
+                            throw makeInvalidWorldFileError("node index out of range");
+                        childNode = nodes[childNodeIndex];
+                        if(childNode->level != level - 1)
+                            throw makeInvalidWorldFileError("child node has wrong level");
+                    }
+                }
+            }
+            nodes.push_back(garbageCollectedHashtable.findOrAddNode(std::move(childNodes)));
+        }
+    }
+    const HashlifeNodeBase *rootNode = nodes.back().get();
+    if(flags & worldFileMemoFlag)
+        rootNode = reader.readMemo(nodes);
+    if(rootNode->isLeaf())
+        throw makeInvalidWorldFileError("root node is a leaf");
+    reader.applyMemo();
+    auto rootNodeReference = rootNode->referenceFromThis<false>();
+    return std::make_shared<Snapshot>(
+        HashlifeNodeReference<const HashlifeNodeBase, true>(rootNodeReference), PrivateAccessTag());
+}
+
+void HashlifeWorld::writeMappedSnapshot(const Snapshot &snapshot, io::OutputStream &os)
+{
+    checkNoEvictedSubtrees(snapshot);
+    MappedSnapshotWriter(snapshot.rootNode.get()).write(os);
+}
+
+constexpr std::size_t HashlifeWorld::MappedWorldFile::nodeRecordSize;
+
+HashlifeWorld::MappedWorldFile::MappedWorldFile(std::shared_ptr<const io::MappedFile> fileIn)
+    : file(std::move(fileIn)),
+      blockKinds(),
+      levelIndex(),
+      nodeRecords(nullptr),
+      nodeCount(0),
+      world(nullptr),
+      materializedNodes()
+{
+    static_assert(nodeRecordSize
+                      == HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize
+                                 * HashlifeNodeBase::levelSize * sizeof(std::uint32_t)
+                             + sizeof(std::uint64_t),
+                  "");
+    auto bytes = file->data();
+    std::size_t size = file->size();
+    if(size < mappedWorldFileHeaderSize)
+        throw makeInvalidWorldFileError("file too short");
+    if(readU32(bytes) != mappedWorldFileMagic)
+        throw makeInvalidWorldFileError("bad magic number");
+    if(readU32(bytes + 4) != mappedWorldFileVersion)
+        throw makeInvalidWorldFileError("unsupported version");
+    std::uint32_t levelCount = readU32(bytes + 8);
+    std::uint32_t blockKindCount = readU32(bytes + 12);
+    nodeCount = readU32(bytes + 16);
+    std::uint32_t nodeRecordsOffset = readU32(bytes + 20);
+    if(levelCount < 2 || levelCount > HashlifeNodeBase::maxLevel + 1U)
+        throw makeInvalidWorldFileError("invalid level count");
+    if(blockKindCount >= (1UL << block::Block::blockKindValueBitWidth))
+        throw makeInvalidWorldFileError("too many block kinds");
+    std::size_t offset = mappedWorldFileHeaderSize;
+    if(size - offset < levelCount * 2 * sizeof(std::uint32_t))
+        throw makeInvalidWorldFileError("file too short");
+    std::uint32_t expectedFirstNodeIndex = 0;
+    for(std::uint32_t level = 0; level < levelCount; level++)
+    {
+        LevelIndexEntry entry;
+        entry.firstNodeIndex = readU32(bytes + offset);
+        entry.nodeCount = readU32(bytes + offset + 4);
+        offset += 2 * sizeof(std::uint32_t);
+        if(entry.firstNodeIndex != expectedFirstNodeIndex || entry.nodeCount == 0
+           || entry.nodeCount > nodeCount - entry.firstNodeIndex)
+            throw makeInvalidWorldFileError("invalid level index");
+        expectedFirstNodeIndex += entry.nodeCount;
+        levelIndex.push_back(entry);
+    }
+    if(expectedFirstNodeIndex != nodeCount || levelIndex.back().nodeCount != 1)
+        throw makeInvalidWorldFileError("invalid level index");
+    blockKinds.push_back(block::BlockKind::empty());
+    for(std::uint32_t i = 0; i < blockKindCount; i++)
+    {
+        if(size - offset < sizeof(std::uint32_t))
+            throw makeInvalidWorldFileError("file too short");
+        std::size_t nameSize = readU32(bytes + offset);
+        offset += sizeof(std::uint32_t);
+        if(size - offset < nameSize)
+            throw makeInvalidWorldFileError("file too short");
+        auto blockDescriptor = block::BlockDescriptor::getByName(
+            std::string(reinterpret_cast<const char *>(bytes + offset), nameSize));
+        offset += nameSize;
+        if(!blockDescriptor)
+            throw makeInvalidWorldFileError("unknown block kind");
+        blockKinds.push_back(blockDescriptor->blockKind);
+    }
+    if(nodeRecordsOffset < offset || nodeRecordsOffset > size
+       || (size - nodeRecordsOffset) / nodeRecordSize < nodeCount)
+        throw makeInvalidWorldFileError("file too short");
+    nodeRecords = bytes + nodeRecordsOffset;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::readMappedNode(
+    const std::shared_ptr<MappedWorldFile> &file,
+    std::uint32_t nodeIndex,
+    HashlifeNodeBase::LevelType level,
+    util::Vector3I32 nodeMinPosition,
+    util::Vector3<std::int64_t> regionMinPosition,
+    util::Vector3<std::int64_t> regionEndPosition)
+{
+    auto record = file->getNodeRecord(nodeIndex);
+    HashlifeNodeReference<const HashlifeNodeBase, false> retval;
+    if(HashlifeNodeBase::isLeaf(level))
+    {
+        HashlifeLeafNode::BlocksArray blocks;
+        for(auto &i : blocks)
+        {
+            for(auto &j : i)
+            {
+                for(auto &block : j)
+                {
+                    auto value = MappedWorldFile::readU32(record);
+                    record += sizeof(std::uint32_t);
+                    auto blockKindIndex = value >> blockKindShift;
+                    if(blockKindIndex >= file->blockKinds.size())
+                        throw makeInvalidWorldFileError("block kind index out of range");
+                    block = block::Block((value & blockLightingMask)
+                                         | (static_cast<block::Block::ValueType>(
+                                                file->blockKinds[blockKindIndex].value)
+                                            << blockKindShift));
+                }
+            }
+        }
+        retval = garbageCollectedHashtable.findOrAddNode(std::move(blocks));
+    }
+    else
+    {
+        auto childNodeIndexes = file->getLevelNodeIndexes(level - 1);
+        auto childSize = HashlifeNodeBase::getSize(level - 1);
+        HashlifeNonleafNode::ChildNodesArray childNodes;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    auto childNodeIndex = MappedWorldFile::readU32(record);
+                    record += sizeof(std::uint32_t);
+                    if(childNodeIndex < std::get<0>(childNodeIndexes)
+                       || childNodeIndex >= std::get<1>(childNodeIndexes))
+                        throw makeInvalidWorldFileError("node index out of range");
+                    childNodes[position.x][position.y][position.z] =
+                        materializeNode(file,
+                                        childNodeIndex,
+                                        level - 1,
+                                        nodeMinPosition + position * util::Vector3I32(childSize),
+                                        regionMinPosition,
+                                        regionEndPosition);
+                }
+            }
+        }
+        retval = garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+    }
+    if(retval->contentHash != file->getNodeContentHash(nodeIndex))
+        throw makeInvalidWorldFileError("node content hash doesn't match");
+    if(!retval->hasStubs)
+        file->materializedNodes.emplace(nodeIndex, retval);
+    return retval;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::materializeNode(
+    const std::shared_ptr<MappedWorldFile> &file,
+    std::uint32_t nodeIndex,
+    HashlifeNodeBase::LevelType level,
+    util::Vector3I32 nodeMinPosition,
+    util::Vector3<std::int64_t> regionMinPosition,
+    util::Vector3<std::int64_t> regionEndPosition)
+{
+    auto iter = file->materializedNodes.find(nodeIndex);
+    if(iter != file->materializedNodes.end())
+        return std::get<1>(*iter);
+    util::Vector3<std::int64_t> nodeEndPosition =
+        util::Vector3<std::int64_t>(nodeMinPosition)
+        + util::Vector3<std::int64_t>(HashlifeNodeBase::getSize(level));
+    bool isInRegion =
+        (regionMinPosition - nodeEndPosition).max() < 0
+        && (util::Vector3<std::int64_t>(nodeMinPosition) - regionEndPosition).max() < 0;
+    if(isInRegion || HashlifeNodeBase::isLeaf(level))
+        return readMappedNode(
+            file, nodeIndex, level, nodeMinPosition, regionMinPosition, regionEndPosition);
+    // the record doesn't have the summary, so use one that's true for any blocks
+    constexpr block::BlockSummary anyBlockSummary(false, false, ~static_cast<std::uint32_t>(0));
+    auto stub =
+        HashlifeNodeBase::makeStub(level,
+                                   anyBlockSummary,
+                                   ~static_cast<HashlifeNodeBase::BlockKindPresenceMask>(0),
+                                   file->getNodeContentHash(nodeIndex),
+                                   garbageCollectedHashtable.getCanonicalEmptyNode(level - 1));
+    StubSource stubSource;
+    stubSource.stub = stub;
+    stubSource.fileOffset = 0;
+    stubSource.fileSize = 0;
+    stubSource.mappedWorldFile = file;
+    stubSource.nodeIndex = nodeIndex;
+    stubSources.emplace(stub.get(), std::move(stubSource));
+    return stub;
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::materializeRegion(
+    const std::shared_ptr<MappedWorldFile> &file,
+    util::Vector3I32 minPosition,
+    util::Vector3I32 maxPosition)
+{
+    constexprAssert(file);
+    constexprAssert(file->world == nullptr || file->world == this);
+    file->world = this;
+    auto rootLevel = file->getRootLevel();
+    auto rootNodeIndex = file->getRootNodeIndex();
+    HashlifeNodeReference<const HashlifeNodeBase, false> rootNode;
+    auto iter = file->materializedNodes.find(rootNodeIndex);
+    if(iter != file->materializedNodes.end())
+        rootNode = std::get<1>(*iter);
+    else
+        rootNode = readMappedNode(
+            file,
+            rootNodeIndex,
+            rootLevel,
+            util::Vector3I32(-HashlifeNodeBase::getHalfSize(rootLevel)),
+            util::Vector3<std::int64_t>(minPosition),
+            util::Vector3<std::int64_t>(maxPosition) + util::Vector3<std::int64_t>(1));
+    return std::make_shared<Snapshot>(HashlifeNodeReference<const HashlifeNodeBase, true>(rootNode),
+                                      PrivateAccessTag());
+}
+
+constexpr std::uint64_t HashlifeWorld::AppendLog::compactionGrowthFactor;
+
+std::uint32_t HashlifeWorld::appendNode(AppendLog &log,
+                                        const HashlifeNodeBase *node,
+                                        io::OutputStream &os)
+{
+    auto iter = log.persistedNodeIndexes.find(node);
+    if(iter != log.persistedNodeIndexes.end())
+        return std::get<1>(*iter);
+    util::Array<std::uint32_t,
+                HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize
+                    * HashlifeNodeBase::levelSize> values;
+    std::size_t valueIndex = 0;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                if(!node->isLeaf())
+                {
+                    values[valueIndex++] =
+                        appendNode(log, getAsNonleaf(node)->getChildNode(position).get(), os);
+                    continue;
+                }
+                auto block = getAsLeaf(node)->getBlock(position);
+                block::Block::ValueType blockKindIndex = 0;
+                if(block.getBlockKind() != block::BlockKind::empty())
+                {
+                    auto blockKindIter =
+                        log.persistedBlockKindIndexes.find(block.getBlockKind().value);
+                    if(blockKindIter == log.persistedBlockKindIndexes.end())
+                    {
+                        auto &name = block::BlockDescriptor::get(block.getBlockKind())->name;
+                        os.writeU8(static_cast<std::uint8_t>(AppendLogRecordType::BlockKind));
+                        os.writeU32(name.size());
+                        os.writeBytes(reinterpret_cast<const unsigned char *>(name.data()),
+                                      name.size());
+                        log.logSize += 1 + sizeof(std::uint32_t) + name.size();
+                        blockKindIter = std::get<0>(log.persistedBlockKindIndexes.emplace(
+                            block.getBlockKind().value,
+                            log.persistedBlockKindIndexes.size() + 1));
+                    }
+                    blockKindIndex = std::get<1>(*blockKindIter);
+                }
+                values[valueIndex++] =
+                    (block.value & blockLightingMask) | (blockKindIndex << blockKindShift);
+            }
+        }
+    }
+    if(node->isLeaf())
+    {
+        os.writeU8(static_cast<std::uint8_t>(AppendLogRecordType::LeafNode));
+        log.logSize += 1;
+    }
+    else
+    {
+        os.writeU8(static_cast<std::uint8_t>(AppendLogRecordType::NonleafNode));
+        os.writeU8(node->level);
+        log.logSize += 2;
+    }
+    for(auto value : values)
+        os.writeU32(value);
+    log.logSize += sizeof(std::uint32_t) * values.size();
+    if(log.persistedNodes.size() >= std::numeric_limits<std::uint32_t>::max())
+        throw io::IOError(std::make_error_code(std::errc::file_too_large),
+                          "too many nodes to write world log");
+    std::uint32_t retval = log.persistedNodes.size();
+    log.persistedNodes.push_back(node->referenceFromThis<false>());
+    log.persistedNodeIndexes.emplace(node, retval);
+    return retval;
+}
+
+std::uint64_t HashlifeWorld::appendSnapshot(AppendLog &log,
+                                            const Snapshot &snapshot,
+                                            io::OutputStream &os)
+{
+    checkNoEvictedSubtrees(snapshot);
+    auto startLogSize = log.logSize;
+    if(log.logSize == 0)
+    {
+        os.writeU32(appendLogMagic);
+        os.writeU32(appendLogVersion);
+        log.logSize += 2 * sizeof(std::uint32_t);
+    }
+    auto rootNodeIndex = appendNode(log, snapshot.rootNode.get(), os);
+    os.writeU8(static_cast<std::uint8_t>(AppendLogRecordType::Root));
+    os.writeU32(rootNodeIndex);
+    log.logSize += 1 + sizeof(std::uint32_t);
+    os.flush();
+    if(log.compactedLogSize == 0)
+        log.compactedLogSize = log.logSize;
+    return log.logSize - startLogSize;
+}
+
+std::uint64_t HashlifeWorld::compactAppendLog(AppendLog &log,
+                                              const Snapshot &snapshot,
+                                              io::OutputStream &os)
+{
+    log.reset();
+    return appendSnapshot(log, snapshot, os);
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::readAppendLog(io::InputStream &is)
+{
+    AppendLog log;
+    return readAppendLog(is, log);
+}
+
+std::shared_ptr<const HashlifeWorld::Snapshot> HashlifeWorld::readAppendLog(io::InputStream &is,
+                                                                            AppendLog &log)
+{
+    if(is.readU32() != appendLogMagic)
+        throw makeInvalidWorldFileError("bad magic number");
+    if(is.readU32() != appendLogVersion)
+        throw makeInvalidWorldFileError("unsupported version");
+    std::uint64_t readSize = 2 * sizeof(std::uint32_t);
+    std::vector<block::BlockKind> blockKinds;
+    blockKinds.push_back(block::BlockKind::empty());
+    std::vector<std::uint64_t> blockKindRecordSizes;
+    blockKindRecordSizes.push_back(0);
+    std::vector<HashlifeNodeReference<const HashlifeNodeBase, false>> nodes;
+    HashlifeNodeReference<const HashlifeNodeBase, false> rootNode;
+    // what was read up to the end of the last complete root
+    std::uint64_t validSize = 0;
+    std::size_t validBlockKindCount = 0;
+    std::size_t validNodeCount = 0;
+    while(true)
+    {
+        std::uint8_t recordType;
+        if(is.readAllBytes(&recordType, 1, false) == 0)
+            break;
+        try
+        {
+            switch(static_cast<AppendLogRecordType>(recordType))
+            {
+            case AppendLogRecordType::BlockKind:
+            {
+                auto name = readName(is, is.readU32());
+                auto blockDescriptor = block::BlockDescriptor::getByName(name);
+                if(!blockDescriptor)
+                    throw makeInvalidWorldFileError("unknown block kind");
+                if(blockKinds.size() >= (1UL << block::Block::blockKindValueBitWidth))
+                    throw makeInvalidWorldFileError("too many block kinds");
+                blockKinds.push_back(blockDescriptor->blockKind);
+                blockKindRecordSizes.push_back(1 + sizeof(std::uint32_t) + name.size());
+                readSize += blockKindRecordSizes.back();
+                break;
+            }
+            case AppendLogRecordType::LeafNode:
+            {
+                HashlifeLeafNode::BlocksArray blocks;
+                for(auto &i : blocks)
+                {
+                    for(auto &j : i)
+                    {
+                        for(auto &block : j)
+                        {
+                            auto value = is.readU32();
+                            auto blockKindIndex = value >> blockKindShift;
+                            if(blockKindIndex >= blockKinds.size())
+                                throw makeInvalidWorldFileError("block kind index out of range");
+                            block = block::Block((value & blockLightingMask)
+                                                 | (static_cast<block::Block::ValueType>(
+                                                        blockKinds[blockKindIndex].value)
+                                                    << blockKindShift));
+                        }
+                    }
+                }
+                nodes.push_back(garbageCollectedHashtable.findOrAddNode(std::move(blocks)));
+                readSize += 1 + sizeof(std::uint32_t) * HashlifeNodeBase::levelSize
+                                    * HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize;
+                break;
+            }
+            case AppendLogRecordType::NonleafNode:
+            {
+                HashlifeNodeBase::LevelType level = is.readU8();
+                if(level == 0 || level > HashlifeNodeBase::maxLevel)
+                    throw makeInvalidWorldFileError("invalid node level");
+                HashlifeNonleafNode::ChildNodesArray childNodes;
+                for(auto &i : childNodes)
+                {
+                    for(auto &j : i)
+                    {
+                        for(auto &childNode : j)
+                        {
+                            auto childNodeIndex = is.readU32();
+                            if(childNodeIndex >= nodes.size())
+                                throw makeInvalidWorldFileError("node index out of range");
+                            childNode = nodes[childNodeIndex];
+                            if(childNode->level != level - 1)
+                                throw makeInvalidWorldFileError("child node has wrong level");
+                        }
+                    }
+                }
+                nodes.push_back(garbageCollectedHashtable.findOrAddNode(std::move(childNodes)));
+                readSize += 2 + sizeof(std::uint32_t) * HashlifeNodeBase::levelSize
+                                    * HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize;
+                break;
+            }
+            case AppendLogRecordType::Root:
+            {
+                auto rootNodeIndex = is.readU32();
+                if(rootNodeIndex >= nodes.size())
+                    throw makeInvalidWorldFileError("node index out of range");
+                if(nodes[rootNodeIndex]->isLeaf())
+                    throw makeInvalidWorldFileError("root node is a leaf");
+                rootNode = nodes[rootNodeIndex];
+                readSize += 1 + sizeof(std::uint32_t);
+                validSize = readSize;
+                validBlockKindCount = blockKinds.size();
+                validNodeCount = nodes.size();
+                break;
+            }
+            default:
+                throw makeInvalidWorldFileError("unknown record type");
+            }
+        }
+        catch(io::EOFError &)
+        {
+            // the last save was interrupted; use the last complete root
+            break;
+        }
+    }
+    if(!rootNode)
+        throw makeInvalidWorldFileError("no complete root");
+    log.reset();
+    for(std::size_t i = 1; i < validBlockKindCount; i++)
+        log.persistedBlockKindIndexes.emplace(blockKinds[i].value, i);
+    nodes.resize(validNodeCount);
+    log.persistedNodes = std::move(nodes);
+    for(std::size_t i = 0; i < log.persistedNodes.size(); i++)
+        log.persistedNodeIndexes.emplace(log.persistedNodes[i].get(), i);
+    log.logSize = validSize;
+    // compaction would write the header, the block kinds, the nodes the root uses, and the root
+    log.compactedLogSize = 2 * sizeof(std::uint32_t) + 1 + sizeof(std::uint32_t);
+    for(std::size_t i = 1; i < validBlockKindCount; i++)
+        log.compactedLogSize += blockKindRecordSizes[i];
+    std::unordered_set<const HashlifeNodeBase *> reachableNodes;
+    std::vector<const HashlifeNodeBase *> nodeStack;
+    nodeStack.push_back(rootNode.get());
+    while(!nodeStack.empty())
+    {
+        auto node = nodeStack.back();
+        nodeStack.pop_back();
+        if(!std::get<1>(reachableNodes.insert(node)))
+            continue;
+        log.compactedLogSize += (node->isLeaf() ? 1 : 2)
+                                + sizeof(std::uint32_t) * HashlifeNodeBase::levelSize
+                                      * HashlifeNodeBase::levelSize * HashlifeNodeBase::levelSize;
+        if(node->isLeaf())
+            continue;
+        for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+        {
+            for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+            {
+                for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+                {
+                    nodeStack.push_back(getAsNonleaf(node)->getChildNode(position).get());
+                }
+            }
+        }
+    }
+    return std::make_shared<Snapshot>(HashlifeNodeReference<const HashlifeNodeBase, true>(rootNode),
+                                      PrivateAccessTag());
+}
+
+namespace
+{
+bool overlapsAnyRegion(
+    util::Vector3I32 minPosition,
+    HashlifeNodeBase::LevelType level,
+    const std::vector<std::pair<util::Vector3I32, util::Vector3I32>> &regions) noexcept
+{
+    util::Vector3<std::int64_t> endPosition = util::Vector3<std::int64_t>(minPosition)
+                                              + util::Vector3<std::int64_t>(
+                                                    HashlifeNodeBase::getSize(level));
+    for(auto &region : regions)
+    {
+        if((util::Vector3<std::int64_t>(std::get<0>(region)) - endPosition).max() < 0
+           && (minPosition - std::get<1>(region)).max() <= 0)
+            return true;
+    }
+    return false;
+}
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::evictNodeSubtrees(
+    const std::shared_ptr<SpillFile> &spillFile,
+    const HashlifeNodeBase *node,
+    util::Vector3I32 nodeMinPosition,
+    const std::vector<std::pair<util::Vector3I32, util::Vector3I32>> &activeRegions,
+    HashlifeNodeBase::LevelType level,
+    std::size_t &evictedCount)
+{
+    if(node->isUniform || node->isStub)
+        return node->referenceFromThis<false>();
+    if(node->level == level)
+    {
+        if(node->hasStubs || overlapsAnyRegion(nodeMinPosition, level, activeRegions))
+            return node->referenceFromThis<false>();
+        SnapshotWriter writer;
+        writer.addNode(node);
+        io::MemoryOutputStream memoryOutputStream;
+        writer.write(memoryOutputStream, true);
+        auto buffer = memoryOutputStream.releaseBuffer();
+        spillFile->outputStream.writeBytes(buffer.data(), buffer.size());
+        spillFile->mappedFile = nullptr;
+        auto stub =
+            HashlifeNodeBase::makeStub(level,
+                                       node->blockSummary,
+                                       node->blockKindPresenceMask,
+                                       node->contentHash,
+                                       garbageCollectedHashtable.getCanonicalEmptyNode(level - 1));
+        StubSource stubSource;
+        stubSource.stub = stub;
+        stubSource.spillFile = spillFile;
+        stubSource.fileOffset = spillFile->fileSize;
+        stubSource.fileSize = buffer.size();
+        stubSources.emplace(stub.get(), std::move(stubSource));
+        spillFile->fileSize += buffer.size();
+        evictedCount++;
+        return stub;
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    bool changed = false;
+    auto childSize = HashlifeNodeBase::getSize(node->level - 1);
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                auto &childNode = getAsNonleaf(node)->getChildNode(position);
+                childNodes[position.x][position.y][position.z] =
+                    evictNodeSubtrees(spillFile,
+                                      childNode.get(),
+                                      nodeMinPosition + position * util::Vector3I32(childSize),
+                                      activeRegions,
+                                      level,
+                                      evictedCount);
+                if(childNodes[position.x][position.y][position.z] != childNode)
+                    changed = true;
+            }
+        }
+    }
+    if(!changed)
+        return node->referenceFromThis<false>();
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+std::size_t HashlifeWorld::evictSubtrees(
+    const std::shared_ptr<SpillFile> &spillFile,
+    const std::vector<std::pair<util::Vector3I32, util::Vector3I32>> &activeRegions,
+    HashlifeNodeBase::LevelType level)
+{
+    constexprAssert(spillFile);
+    constexprAssert(level >= 1);
+    if(level >= rootNode->level)
+        return 0;
+    std::size_t evictedCount = 0;
+    rootNode = evictNodeSubtrees(spillFile,
+                                 rootNode.get(),
+                                 util::Vector3I32(-rootNode->getHalfSize()),
+                                 activeRegions,
+                                 level,
+                                 evictedCount);
+    spillFile->outputStream.flush();
+    return evictedCount;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::loadStub(
+    const HashlifeNodeBase *stub,
+    util::Vector3I32 stubMinPosition,
+    util::Vector3<std::int64_t> minPosition,
+    util::Vector3<std::int64_t> endPosition)
+{
+    auto iter = stubSources.find(stub);
+    constexprAssert(iter != stubSources.end());
+    auto &stubSource = std::get<1>(*iter);
+    if(stubSource.mappedWorldFile)
+        return readMappedNode(stubSource.mappedWorldFile,
+                              stubSource.nodeIndex,
+                              stub->level,
+                              stubMinPosition,
+                              minPosition,
+                              endPosition);
+    auto &spillFile = *stubSource.spillFile;
+    if(!spillFile.mappedFile)
+    {
+        spillFile.outputStream.flush();
+        spillFile.mappedFile = std::make_shared<io::MappedFile>(spillFile.fileName);
+    }
+    if(spillFile.mappedFile->size() < stubSource.fileOffset + stubSource.fileSize)
+        throw makeInvalidWorldFileError("spill file too short");
+    io::MemoryInputStream is(spillFile.mappedFile->data() + stubSource.fileOffset,
+                             stubSource.fileSize);
+    HashlifeNodeReference<const HashlifeNodeBase, false> retval(readSnapshot(is)->rootNode);
+    if(retval->level != stub->level || retval->contentHash != stub->contentHash)
+        throw makeInvalidWorldFileError("spilled subtree doesn't match");
+    return retval;
+}
+
+HashlifeNodeReference<const HashlifeNodeBase, false> HashlifeWorld::faultInNode(
+    const HashlifeNodeBase *node,
+    util::Vector3I32 nodeMinPosition,
+    util::Vector3<std::int64_t> minPosition,
+    util::Vector3<std::int64_t> endPosition,
+    std::size_t &faultedInCount)
+{
+    util::Vector3<std::int64_t> nodeEndPosition =
+        util::Vector3<std::int64_t>(nodeMinPosition)
+        + util::Vector3<std::int64_t>(node->getSize());
+    if(!node->hasStubs || (minPosition - nodeEndPosition).max() >= 0
+       || (util::Vector3<std::int64_t>(nodeMinPosition) - endPosition).max() >= 0)
+        return node->referenceFromThis<false>();
+    if(node->isStub)
+    {
+        faultedInCount++;
+        return loadStub(node, nodeMinPosition, minPosition, endPosition);
+    }
+    HashlifeNonleafNode::ChildNodesArray childNodes;
+    auto childSize = HashlifeNodeBase::getSize(node->level - 1);
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                childNodes[position.x][position.y][position.z] =
+                    faultInNode(getAsNonleaf(node)->getChildNode(position).get(),
+                                nodeMinPosition + position * util::Vector3I32(childSize),
+                                minPosition,
+                                endPosition,
+                                faultedInCount);
+            }
+        }
+    }
+    return garbageCollectedHashtable.findOrAddNode(std::move(childNodes));
+}
+
+std::size_t HashlifeWorld::faultInSubtrees(util::Vector3I32 minPosition,
+                                           util::Vector3I32 maxPosition)
+{
+    if(!rootNode->hasStubs)
+        return 0;
+    std::size_t faultedInCount = 0;
+    rootNode =
+        faultInNode(rootNode.get(),
+                    util::Vector3I32(-rootNode->getHalfSize()),
+                    util::Vector3<std::int64_t>(minPosition),
+                    util::Vector3<std::int64_t>(maxPosition) + util::Vector3<std::int64_t>(1),
+                    faultedInCount);
+    return faultedInCount;
+}
+
+std::size_t HashlifeWorld::getStubCount(const HashlifeNodeBase *node) noexcept
+{
+    if(!node->hasStubs)
+        return 0;
+    if(node->isStub)
+        return 1;
+    std::size_t retval = 0;
+    for(util::Vector3I32 position(0); position.x < HashlifeNodeBase::levelSize; position.x++)
+    {
+        for(position.y = 0; position.y < HashlifeNodeBase::levelSize; position.y++)
+        {
+            for(position.z = 0; position.z < HashlifeNodeBase::levelSize; position.z++)
+            {
+                retval += getStubCount(getAsNonleaf(node)->getChildNode(position).get());
+            }
+        }
+    }
+    return retval;
+}
+}
+}
+}
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "mesh_cache.h"
+#include "../io/file_stream.h"
+#include "../io/memory_stream.h"
+#include "../io/lz_stream.h"
+#include "../resource/resource.h"
+#include "../logging/logging.h"
+#include <system_error>
+#include <exception>
+#include <utility>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace world
+{
+/* mesh cache file format, all integers are little endian:
+ * u32 magic ("VXMC")
+ * u32 version
+ * u64 block::BlockDescriptor::getRenderFingerprint() of the code that made the meshes; the file
+ * is discarded if it doesn't match
+ * everything after the fingerprint is compressed by io::LZCompressingOutputStream:
+ * var entry count
+ * for each entry, the most recently used first:
+ *     u64 key
+ * for each entry, in the same order:
+ *     var encoded mesh size
+ *     encoded mesh bytes
+ * var is an unsigned LEB128 variable length integer
+ *
+ * encoded mesh:
+ * var texture count, not counting the empty texture which is always index 0
+ * for each texture:
+ *     var name length
+ *     name bytes: the name passed to resource::readResourceTexture
+ * var render layer count
+ * for each render layer:
+ *     var triangle count
+ *     for each triangle:
+ *         var texture index
+ *         for each vertex:
+ *             f32 position x, y, and z
+ *             f32 texture coordinates u and v
+ *             f32 color red, green, blue, and opacity
+ *             f32 normal x, y, and z
+ */
+namespace
+{
+constexpr std::uint32_t meshCacheFileMagic = 0x434D5856UL; // "VXMC"
+constexpr std::uint32_t meshCacheFileVersion = 1;
+/** the smallest encoded triangle: a one byte texture index and 12 f32s for each vertex */
+constexpr std::size_t minimumEncodedTriangleSize =
+    1 + graphics::Triangle::vertexCount * 12 * sizeof(float);
+
+io::IOError makeInvalidMeshCacheFileError(const std::string &message)
+{
+    return io::IOError(std::make_error_code(std::errc::illegal_byte_sequence),
+                       "invalid mesh cache file: " + message);
+}
+}
+
+constexpr std::uint64_t MeshCache::defaultMaximumSize;
+
+MeshCache::MeshCache(std::string fileName, std::uint64_t maximumSize)
+    : fileName(std::move(fileName)),
+      maximumSize(maximumSize),
+      lock(),
+      loadedCond(),
+      entries(),
+      entryList(),
+      size(0),
+      pendingKeys(),
+      loadDone(false),
+      stopLoading(false),
+      loadThread()
+{
+    loadThread = threading::Thread("MeshCache load",
+                                   [this]()
+                                   {
+                                       loadThreadFn();
+                                   });
+}
+
+MeshCache::~MeshCache()
+{
+    std::unique_lock<std::mutex> lockIt(lock);
+    stopLoading = true;
+    lockIt.unlock();
+    loadThread.join();
+}
+
+void MeshCache::loadThreadFn() noexcept
+{
+    try
+    {
+        std::unique_ptr<io::FileInputStream> fileInputStream;
+        try
+        {
+            fileInputStream.reset(new io::FileInputStream(fileName));
+        }
+        catch(io::IOError &)
+        {
+            // no cache yet
+        }
+        if(fileInputStream)
+        {
+            if(fileInputStream->readU32() != meshCacheFileMagic)
+                throw makeInvalidMeshCacheFileError("bad magic number");
+            if(fileInputStream->readU32() != meshCacheFileVersion)
+                throw makeInvalidMeshCacheFileError("unsupported version");
+            if(fileInputStream->readU64() != block::BlockDescriptor::getRenderFingerprint())
+            {
+                logging::log(logging::Level::Info,
+                             "MeshCache",
+                             "discarding mesh cache file " + fileName
+                                 + " made by different block rendering code");
+                fileInputStream.reset();
+            }
+        }
+        if(fileInputStream)
+        {
+            io::LZDecompressingInputStream is(*fileInputStream);
+            std::uint32_t entryCount = is.readVarU32();
+            // every encoded mesh is at least one byte, so more can't fit
+            if(entryCount > maximumSize)
+                throw makeInvalidMeshCacheFileError("too many entries");
+            // not reserved, so a bad count can't allocate more than the keys actually read
+            std::vector<std::uint64_t> keys;
+            for(std::uint32_t i = 0; i < entryCount; i++)
+                keys.push_back(is.readU64());
+            std::unique_lock<std::mutex> lockIt(lock);
+            pendingKeys.insert(keys.begin(), keys.end());
+            lockIt.unlock();
+            for(auto key : keys)
+            {
+                std::uint32_t encodedMeshSize = is.readVarU32();
+                if(encodedMeshSize > maximumSize)
+                    throw makeInvalidMeshCacheFileError("entry too big");
+                auto encodedMesh = std::make_shared<std::vector<unsigned char>>();
+                encodedMesh->resize(encodedMeshSize);
+                is.readAllBytes(encodedMesh->data(), encodedMesh->size());
+                lockIt.lock();
+                if(stopLoading)
+                    break;
+                pendingKeys.erase(key);
+                if(!entries.count(key))
+                    addEntry(key, std::move(encodedMesh), false);
+                loadedCond.notify_all();
+                lockIt.unlock();
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        // the cache can always be rebuilt, so a bad file is never fatal
+        logging::log(logging::Level::Warning,
+                     "MeshCache",
+                     "can't read mesh cache file " + fileName + ": " + e.what());
+    }
+    std::unique_lock<std::mutex> lockIt(lock);
+    pendingKeys.clear();
+    loadDone = true;
+    loadedCond.notify_all();
+}
+
+void MeshCache::addEntry(std::uint64_t key,
+                         std::shared_ptr<const std::vector<unsigned char>> encodedMesh,
+                         bool isMostRecentlyUsed)
+{
+    size += encodedMesh->size();
+    Entry &entry = entries[key];
+    entry.encodedMesh = std::move(encodedMesh);
+    entry.entryListIterator =
+        entryList.insert(isMostRecentlyUsed ? entryList.begin() : entryList.end(), key);
+    while(size > maximumSize && !entryList.empty())
+    {
+        auto iter = entries.find(entryList.back());
+        size -= std::get<1>(*iter).encodedMesh->size();
+        entries.erase(iter);
+        entryList.pop_back();
+    }
+}
+
+std::vector<unsigned char> MeshCache::encodeMesh(const graphics::ReadableRenderBuffer &mesh)
+{
+    io::MemoryOutputStream os;
+    std::unordered_map<graphics::TextureImplementation *, std::uint32_t> textureIndexes;
+    std::vector<std::string> textureNames;
+    util::EnumArray<std::vector<graphics::Triangle>, graphics::RenderLayer> triangles;
+    for(auto renderLayer : util::EnumTraits<graphics::RenderLayer>::values)
+    {
+        triangles[renderLayer].resize(mesh.getTriangleCount(renderLayer));
+        mesh.readTriangles(
+            renderLayer, triangles[renderLayer].data(), triangles[renderLayer].size());
+        for(auto &triangle : triangles[renderLayer])
+        {
+            if(!triangle.texture.value || textureIndexes.count(triangle.texture.value))
+                continue;
+            auto name = resource::getResourceTextureName(triangle.texture);
+            if(name.empty())
+                return {};
+            textureNames.push_back(std::move(name));
+            textureIndexes.emplace(triangle.texture.value, textureNames.size());
+        }
+    }
+    os.writeVarU32(textureNames.size());
+    for(auto &textureName : textureNames)
+    {
+        os.writeVarU32(textureName.size());
+        os.writeBytes(reinterpret_cast<const unsigned char *>(textureName.data()),
+                      textureName.size());
+    }
+    os.writeVarU32(util::EnumTraits<graphics::RenderLayer>::size);
+    for(auto renderLayer : util::EnumTraits<graphics::RenderLayer>::values)
+    {
+        os.writeVarU32(triangles[renderLayer].size());
+        for(auto &triangle : triangles[renderLayer])
+        {
+            os.writeVarU32(triangle.texture.value ? textureIndexes.at(triangle.texture.value) : 0);
+            for(auto &vertex : triangle.vertices)
+            {
+                os.writeF32(vertex.positionX);
+                os.writeF32(vertex.positionY);
+                os.writeF32(vertex.positionZ);
+                os.writeF32(vertex.textureCoordinatesU);
+                os.writeF32(vertex.textureCoordinatesV);
+                os.writeF32(vertex.colorRed);
+                os.writeF32(vertex.colorGreen);
+                os.writeF32(vertex.colorBlue);
+                os.writeF32(vertex.colorOpacity);
+                os.writeF32(vertex.normalX);
+                os.writeF32(vertex.normalY);
+                os.writeF32(vertex.normalZ);
+            }
+        }
+    }
+    return os.releaseBuffer();
+}
+
+std::shared_ptr<graphics::ReadableRenderBuffer> MeshCache::decodeMesh(
+    std::shared_ptr<const std::vector<unsigned char>> encodedMesh)
+{
+    io::MemoryInputStream is(std::move(encodedMesh));
+    std::vector<graphics::TextureId> textures;
+    textures.push_back(graphics::TextureId());
+    std::uint32_t textureCount = is.readVarU32();
+    if(textureCount > is.getRemainingSize())
+        throw makeInvalidMeshCacheFileError("texture count too big");
+    for(std::uint32_t i = 0; i < textureCount; i++)
+    {
+        std::uint32_t nameSize = is.readVarU32();
+        if(nameSize > is.getRemainingSize())
+            throw makeInvalidMeshCacheFileError("texture name too long");
+        std::string name;
+        name.resize(nameSize);
+        is.readAllBytes(reinterpret_cast<unsigned char *>(&name[0]), name.size());
+        auto texture = resource::findResourceTexture(name);
+        if(!texture.value)
+            return nullptr;
+        textures.push_back(texture);
+    }
+    if(is.readVarU32() != util::EnumTraits<graphics::RenderLayer>::size)
+        throw makeInvalidMeshCacheFileError("wrong render layer count");
+    auto retval = std::make_shared<graphics::MemoryRenderBuffer>();
+    std::vector<graphics::Triangle> triangles;
+    for(auto renderLayer : util::EnumTraits<graphics::RenderLayer>::values)
+    {
+        std::uint32_t triangleCount = is.readVarU32();
+        if(triangleCount > is.getRemainingSize() / minimumEncodedTriangleSize)
+            throw makeInvalidMeshCacheFileError("triangle count too big");
+        triangles.resize(triangleCount);
+        for(auto &triangle : triangles)
+        {
+            auto textureIndex = is.readVarU32();
+            if(textureIndex >= textures.size())
+                throw makeInvalidMeshCacheFileError("texture index out of range");
+            triangle.texture = textures[textureIndex];
+            for(auto &vertex : triangle.vertices)
+            {
+                vertex.positionX = is.readF32();
+                vertex.positionY = is.readF32();
+                vertex.positionZ = is.readF32();
+                vertex.textureCoordinatesU = is.readF32();
+                vertex.textureCoordinatesV = is.readF32();
+                vertex.colorRed = is.readF32();
+                vertex.colorGreen = is.readF32();
+                vertex.colorBlue = is.readF32();
+                vertex.colorOpacity = is.readF32();
+                vertex.normalX = is.readF32();
+                vertex.normalY = is.readF32();
+                vertex.normalZ = is.readF32();
+            }
+        }
+        retval->appendTriangles(renderLayer, triangles.data(), triangles.size());
+    }
+    retval->finish();
+    return retval;
+}
+
+std::shared_ptr<graphics::ReadableRenderBuffer> MeshCache::find(std::uint64_t key)
+{
+    std::unique_lock<std::mutex> lockIt(lock);
+    while(true)
+    {
+        auto iter = entries.find(key);
+        if(iter != entries.end())
+        {
+            auto &entry = std::get<1>(*iter);
+            entryList.splice(entryList.begin(), entryList, entry.entryListIterator);
+            auto encodedMesh = entry.encodedMesh;
+            lockIt.unlock();
+            try
+            {
+                return decodeMesh(encodedMesh);
+            }
+            catch(std::exception &e)
+            {
+                logging::log(logging::Level::Warning,
+                             "MeshCache",
+                             std::string("can't decode cached mesh: ") + e.what());
+            }
+            // treat it as a miss and drop it so it isn't saved again
+            lockIt.lock();
+            iter = entries.find(key);
+            if(iter != entries.end() && std::get<1>(*iter).encodedMesh == encodedMesh)
+            {
+                size -= encodedMesh->size();
+                entryList.erase(std::get<1>(*iter).entryListIterator);
+                entries.erase(iter);
+            }
+            return nullptr;
+        }
+        if(!pendingKeys.count(key))
+            return nullptr;
+        loadedCond.wait(lockIt);
+    }
+}
+
+bool MeshCache::insert(std::uint64_t key, const graphics::ReadableRenderBuffer &mesh)
+{
+    auto encodedMesh = std::make_shared<std::vector<unsigned char>>(encodeMesh(mesh));
+    if(encodedMesh->empty())
+        return false;
+    std::unique_lock<std::mutex> lockIt(lock);
+    auto iter = entries.find(key);
+    if(iter != entries.end())
+    {
+        size -= std::get<1>(*iter).encodedMesh->size();
+        entryList.erase(std::get<1>(*iter).entryListIterator);
+        entries.erase(iter);
+    }
+    addEntry(key, std::move(encodedMesh), true);
+    return true;
+}
+
+std::shared_ptr<graphics::ReadableRenderBuffer> MeshCache::renderRenderCacheEntry(
+    const std::shared_ptr<HashlifeWorld::RenderCacheEntryReference> &renderCacheEntryReference)
+{
+    // chunks that don't render anything are faster to render than to look up
+    if(!renderCacheEntryReference->getBlockSummary().rendersAnything())
+        return HashlifeWorld::renderRenderCacheEntry(renderCacheEntryReference);
+    auto key = renderCacheEntryReference->getContentHash();
+    auto retval = find(key);
+    if(retval)
+        return retval;
+    retval = HashlifeWorld::renderRenderCacheEntry(renderCacheEntryReference);
+    insert(key, *retval);
+    return retval;
+}
+
+void MeshCache::save()
+{
+    waitUntilLoaded();
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<const std::vector<unsigned char>>>>
+        savedEntries;
+    std::unique_lock<std::mutex> lockIt(lock);
+    savedEntries.reserve(entryList.size());
+    for(auto key : entryList)
+        savedEntries.emplace_back(key, entries.at(key).encodedMesh);
+    lockIt.unlock();
+    std::string temporaryFileName = fileName + ".tmp";
+    {
+        io::FileOutputStream fileOutputStream(temporaryFileName);
+        fileOutputStream.writeU32(meshCacheFileMagic);
+        fileOutputStream.writeU32(meshCacheFileVersion);
+        fileOutputStream.writeU64(block::BlockDescriptor::getRenderFingerprint());
+        io::LZCompressingOutputStream os(fileOutputStream);
+        os.writeVarU32(savedEntries.size());
+        for(auto &savedEntry : savedEntries)
+            os.writeU64(std::get<0>(savedEntry));
+        for(auto &savedEntry : savedEntries)
+        {
+            auto &encodedMesh = *std::get<1>(savedEntry);
+            os.writeVarU32(encodedMesh.size());
+            os.writeBytes(encodedMesh.data(), encodedMesh.size());
+        }
+        os.finish();
+        fileOutputStream.close();
+    }
+    io::replaceFile(temporaryFileName, fileName);
+}
+
+void MeshCache::waitUntilLoaded()
+{
+    std::unique_lock<std::mutex> lockIt(lock);
+    while(!loadDone)
+        loadedCond.wait(lockIt);
+}
+
+std::uint64_t MeshCache::getSize()
+{
+    std::unique_lock<std::mutex> lockIt(lock);
+    return size;
+}
+
+std::size_t MeshCache::getEntryCount()
+{
+    std::unique_lock<std::mutex> lockIt(lock);
+    return entries.size();
+}
+}
+}
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012-2017 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef WORLD_MESH_CACHE_H_
+#define WORLD_MESH_CACHE_H_
+
+#include "hashlife_world.h"
+#include "../graphics/render.h"
+#include "../threading/threading.h"
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <list>
+#include <vector>
+
+namespace programmerjake
+{
+namespace voxels
+{
+namespace world
+{
+/** a cache of the meshes made by HashlifeWorld::renderRenderCacheEntry that is kept in a file
+ * between runs, so chunks that haven't changed don't need to be meshed again after a restart.
+ * Entries are keyed by HashlifeWorld::RenderCacheEntryReference::getContentHash, and the least
+ * recently used entries are removed when the total size of the encoded meshes is over the
+ * maximum size. The file is discarded when block::BlockDescriptor::getRenderFingerprint changes.
+ * @note the file is read in a background thread, and is only written by save
+ */
+class MeshCache final
+{
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+private:
+    struct Entry final
+    {
+        std::shared_ptr<const std::vector<unsigned char>> encodedMesh;
+        std::list<std::uint64_t>::iterator entryListIterator;
+    };
+
+public:
+    static constexpr std::uint64_t defaultMaximumSize = 64UL << 20; // 64MiB
+
+private:
+    const std::string fileName;
+    const std::uint64_t maximumSize;
+    std::mutex lock;
+    std::condition_variable loadedCond;
+    std::unordered_map<std::uint64_t, Entry> entries;
+    /** most recently used first */
+    std::list<std::uint64_t> entryList;
+    std::uint64_t size;
+    /** the keys in the file that haven't been read yet */
+    std::unordered_set<std::uint64_t> pendingKeys;
+    bool loadDone;
+    bool stopLoading;
+    threading::Thread loadThread;
+
+private:
+    void loadThreadFn() noexcept;
+    /** lock must be held */
+    void addEntry(std::uint64_t key,
+                  std::shared_ptr<const std::vector<unsigned char>> encodedMesh,
+                  bool isMostRecentlyUsed);
+    /** @return empty if the mesh uses a texture that wasn't made by
+     * resource::readResourceTexture */
+    static std::vector<unsigned char> encodeMesh(const graphics::ReadableRenderBuffer &mesh);
+    /** @return null if the mesh uses a texture that isn't loaded */
+    static std::shared_ptr<graphics::ReadableRenderBuffer> decodeMesh(
+        std::shared_ptr<const std::vector<unsigned char>> encodedMesh);
+
+public:
+    /** start reading fileName in the background. A missing or invalid file gives an empty cache.
+     */
+    explicit MeshCache(std::string fileName, std::uint64_t maximumSize = defaultMaximumSize);
+    ~MeshCache();
+    /** @return the cached mesh for key or null if there isn't one. If key is in the file but
+     * hasn't been read yet, waits until it has.
+     */
+    std::shared_ptr<graphics::ReadableRenderBuffer> find(std::uint64_t key);
+    /** add mesh to the cache
+     * @return false if mesh can't be cached because it uses a texture that wasn't made by
+     * resource::readResourceTexture
+     */
+    bool insert(std::uint64_t key, const graphics::ReadableRenderBuffer &mesh);
+    /** like HashlifeWorld::renderRenderCacheEntry, but use the cached mesh if there is one and
+     * add the mesh to the cache otherwise */
+    std::shared_ptr<graphics::ReadableRenderBuffer> renderRenderCacheEntry(
+        const std::shared_ptr<HashlifeWorld::RenderCacheEntryReference> &renderCacheEntryReference);
+    /** write the cache to the file, replacing it
+     * @throw io::IOError if the file can't be written
+     */
+    void save();
+    void waitUntilLoaded();
+    /** the total size of the encoded meshes in bytes */
+    std::uint64_t getSize();
+    std::size_t getEntryCount();
+};
+}
+}
+}
+
+#endif /* WORLD_MESH_CACHE_H_ */
@@ -22,6 +22,8 @@
 #include <chrono>
 #include <cmath>
 #include "../threading/threading.h"
+#include "../io/file_stream.h"
+#include "../io/buffered_stream.h"
 
 namespace programmerjake
 {
@@ -29,6 +31,33 @@ namespace voxels
 {
 namespace world
 {
+namespace
+{
+/** writes to outputStream, calling onWrite with the number of bytes written */
+class ProgressOutputStream final : public io::OutputStream
+{
+private:
+    io::OutputStream &outputStream;
+    std::function<void(std::size_t byteCount)> onWrite;
+
+public:
+    ProgressOutputStream(io::OutputStream &outputStream,
+                         std::function<void(std::size_t byteCount)> onWrite)
+        : outputStream(outputStream), onWrite(std::move(onWrite))
+    {
+    }
+    virtual void writeBytes(const unsigned char *bytes, std::size_t byteCount) override
+    {
+        outputStream.writeBytes(bytes, byteCount);
+        onWrite(byteCount);
+    }
+    virtual void flush() override
+    {
+        outputStream.flush();
+    }
+};
+}
+
 void World::moveThreadFn(std::shared_ptr<DimensionData> dimensionData) noexcept
 {
     auto hashlifeWorld = HashlifeWorld::make();
@@ -123,8 +152,105 @@ std::shared_ptr<World::DimensionData> World::makeDimensionData(Dimension dimensi
     return retval;
 }
 
+void World::save(const SaveQueueItem &item)
+{
+    auto &progress = *item.progress;
+    for(auto &snapshotEntry : item.snapshots)
+    {
+        std::string fileName =
+            item.fileNamePrefix + std::get<0>(snapshotEntry).getName() + ".vxhl";
+        std::string temporaryFileName = fileName + ".tmp";
+        {
+            io::FileOutputStream fileOutputStream(temporaryFileName);
+            ProgressOutputStream progressOutputStream(fileOutputStream,
+                                                      [&](std::size_t byteCount)
+                                                      {
+                                                          std::unique_lock<std::mutex> lockIt(
+                                                              progress.lock);
+                                                          progress.bytesWritten += byteCount;
+                                                      });
+            io::BufferedOutputStream os(progressOutputStream);
+            HashlifeWorld::writeSnapshot(*std::get<1>(snapshotEntry), os, item.useCompression);
+            os.flush();
+            fileOutputStream.close();
+        }
+        io::replaceFile(temporaryFileName, fileName);
+        std::unique_lock<std::mutex> lockIt(progress.lock);
+        progress.savedDimensionCount++;
+    }
+}
+
+void World::saveThreadFn() noexcept
+{
+    std::unique_lock<std::mutex> lockIt(saveThreadLock);
+    while(true)
+    {
+        if(!saveQueue.empty())
+        {
+            auto item = std::move(saveQueue.front());
+            saveQueue.pop_front();
+            lockIt.unlock();
+            std::exception_ptr error;
+            try
+            {
+                save(item);
+            }
+            catch(...)
+            {
+                error = std::current_exception();
+            }
+            item.snapshots.clear(); // let the move threads collect the saved nodes
+            std::unique_lock<std::mutex> lockedProgress(item.progress->lock);
+            item.progress->error = error;
+            item.progress->done = true;
+            item.progress->cond.notify_all();
+            lockedProgress.unlock();
+            lockIt.lock();
+            continue;
+        }
+        if(saveThreadDone)
+            break;
+        saveThreadCond.wait(lockIt);
+    }
+}
+
+std::shared_ptr<const World::SaveProgress> World::startSave(std::string fileNamePrefix,
+                                                            bool useCompression)
+{
+    SaveQueueItem item;
+    item.fileNamePrefix = std::move(fileNamePrefix);
+    item.useCompression = useCompression;
+    std::unique_lock<std::mutex> lockedDimensionDataMap(dimensionDataMapLock);
+    for(auto &dimensionEntry : dimensionDataMap)
+    {
+        auto &dimensionData = std::get<1>(dimensionEntry);
+        std::unique_lock<std::mutex> lockedSnapshot(dimensionData->snapshotLock);
+        item.snapshots.emplace_back(dimensionData->dimension, dimensionData->snapshot);
+    }
+    lockedDimensionDataMap.unlock();
+    item.progress = std::make_shared<SaveProgress>(item.snapshots.size());
+    auto retval = item.progress;
+    std::unique_lock<std::mutex> lockIt(saveThreadLock);
+    constexprAssert(!saveThreadDone);
+    if(!saveThread.joinable())
+        saveThread = threading::Thread([this]()
+                                       {
+                                           saveThreadFn();
+                                       });
+    saveQueue.push_back(std::move(item));
+    saveThreadCond.notify_all();
+    return retval;
+}
+
 World::~World()
 {
+    // the saved nodes belong to the move threads' worlds, so finish saving first
+    std::unique_lock<std::mutex> lockedSaveThread(saveThreadLock);
+    saveThreadDone = true;
+    saveThreadCond.notify_all();
+    lockedSaveThread.unlock();
+    if(saveThread.joinable())
+        saveThread.join();
     for(auto &dimensionEntry : dimensionDataMap)
     {
         auto &dimensionData = std::get<1>(dimensionEntry);
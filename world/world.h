@@ -32,6 +32,10 @@
 #include "../threading/threading.h"
 #include <functional>
 #include <deque>
+#include <vector>
+#include <string>
+#include <exception>
+#include <cstdint>
 
 namespace programmerjake
 {
@@ -41,6 +45,66 @@ namespace world
 {
 class World final
 {
+public:
+    /** the progress of a save started by World::startSave */
+    class SaveProgress final
+    {
+        friend class World;
+        SaveProgress(const SaveProgress &) = delete;
+        SaveProgress &operator=(const SaveProgress &) = delete;
+
+    private:
+        mutable std::mutex lock;
+        mutable std::condition_variable cond;
+        const std::size_t dimensionCount;
+        std::size_t savedDimensionCount;
+        std::uint64_t bytesWritten;
+        bool done;
+        std::exception_ptr error;
+
+    public:
+        explicit SaveProgress(std::size_t dimensionCount)
+            : lock(),
+              cond(),
+              dimensionCount(dimensionCount),
+              savedDimensionCount(0),
+              bytesWritten(0),
+              done(false),
+              error()
+        {
+        }
+        std::size_t getDimensionCount() const noexcept
+        {
+            return dimensionCount;
+        }
+        std::size_t getSavedDimensionCount() const
+        {
+            std::unique_lock<std::mutex> lockIt(lock);
+            return savedDimensionCount;
+        }
+        std::uint64_t getBytesWritten() const
+        {
+            std::unique_lock<std::mutex> lockIt(lock);
+            return bytesWritten;
+        }
+        /** @return true if the save finished or failed */
+        bool isDone() const
+        {
+            std::unique_lock<std::mutex> lockIt(lock);
+            return done;
+        }
+        /** wait for the save to finish
+         * @throw io::IOError if it failed */
+        void wait() const
+        {
+            std::unique_lock<std::mutex> lockIt(lock);
+            while(!done)
+                cond.wait(lockIt);
+            if(error)
+                std::rethrow_exception(error);
+        }
+    };
+
 private:
     struct PrivateAccess final
     {
@@ -123,8 +187,19 @@ private:
         }
     };
 
+    struct SaveQueueItem final
+    {
+        std::string fileNamePrefix;
+        bool useCompression;
+        std::vector<std::pair<Dimension, std::shared_ptr<const HashlifeWorld::Snapshot>>>
+            snapshots;
+        std::shared_ptr<SaveProgress> progress;
+    };
+
 private:
     void moveThreadFn(std::shared_ptr<DimensionData> dimensionData) noexcept;
+    void saveThreadFn() noexcept;
+    static void save(const SaveQueueItem &item);
     static std::shared_ptr<WorkQueueItemState> scheduleOnMoveThread(
         const std::shared_ptr<DimensionData> &dimensionData,
         std::function<DimensionData::MoveThreadWorkQueueFunction> function);
@@ -144,9 +219,21 @@ private:
 private:
     DimensionMap<std::shared_ptr<DimensionData>> dimensionDataMap;
     std::mutex dimensionDataMapLock;
+    threading::Thread saveThread;
+    std::mutex saveThreadLock;
+    std::condition_variable saveThreadCond;
+    std::deque<SaveQueueItem> saveQueue;
+    bool saveThreadDone;
 
 public:
-    World(PrivateAccess) : dimensionDataMap()
+    World(PrivateAccess)
+        : dimensionDataMap(),
+          dimensionDataMapLock(),
+          saveThread(),
+          saveThreadLock(),
+          saveThreadCond(),
+          saveQueue(),
+          saveThreadDone(false)
     {
     }
     ~World();
@@ -173,6 +260,23 @@ public:
             resultState);
         constexprAssert(resultState == WorkQueueItemState::Finished);
     }
+    /** set many scattered blocks in one dimension at once.
+     * @see HashlifeWorld::applyEdits
+     */
+    void applyEdits(Dimension dimension, std::vector<HashlifeWorld::BlockEdit> edits)
+    {
+        auto dimensionData = getOrMakeDimensionData(dimension);
+        WorkQueueItemState::State resultState;
+        runOnMoveThread(
+            dimensionData,
+            [&](const std::shared_ptr<HashlifeWorld> &hashlifeWorld,
+                block::BlockStepGlobalState &blockStepGlobalState) noexcept
+            {
+                hashlifeWorld->applyEdits(std::move(edits));
+            },
+            resultState);
+        constexprAssert(resultState == WorkQueueItemState::Finished);
+    }
     template <typename BlocksArray>
     void getBlocks(BlocksArray &&blocksArray,
                    Position3I32 worldPosition,
@@ -198,6 +302,15 @@ public:
         std::unique_lock<std::mutex> lockIt(dimensionData->snapshotLock);
         return dimensionData->snapshot;
     }
+    /** start saving the current snapshot of every dimension on the save thread, so stepping
+     * isn't stopped while the files are written. Each dimension is written to
+     * fileNamePrefix + Dimension::getName() + ".vxhl" by HashlifeWorld::writeSnapshot through a
+     * fixed size buffer, and replaces the old file only once it is completely written.
+     * Saves are written in the order they are started; the world finishes them before it is
+     * destroyed.
+     */
+    std::shared_ptr<const SaveProgress> startSave(std::string fileNamePrefix,
+                                                  bool useCompression = true);
 };
 }
 }